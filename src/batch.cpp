@@ -0,0 +1,226 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <streambuf>
+#include <thread>
+
+namespace pgToSqlite {
+
+	namespace {
+		// Writes the output of a job line by line with a prefix, so concurrent jobs do not mix within lines.
+		// Text ended by '\r' is progress meant to be overwritten in a terminal, it is dropped.
+		class JobOutputBuffer : public std::streambuf {
+		  public:
+			JobOutputBuffer(std::ostream &out, std::mutex &outLock, const std::string &prefix) :
+				lOut(out),
+				lOutLock(outLock),
+				lPrefix(prefix) {
+			}
+			~JobOutputBuffer() override {
+				if (!line.empty()) {
+					writeLine();
+				}
+			}
+
+			// Writes a line directly, e.g. throttled progress.
+			void writeLine(const std::string &text) {
+				std::lock_guard<std::mutex> guard(lOutLock);
+				lOut << lPrefix << text << std::endl;
+			}
+
+		  protected:
+			int_type overflow(int_type ch) override {
+				if (traits_type::eq_int_type(ch, traits_type::eof())) {
+					return traits_type::not_eof(ch);
+				}
+				char c = traits_type::to_char_type(ch);
+				if (c == '\n') {
+					writeLine();
+				} else if (c == '\r') {
+					line.clear();
+				} else {
+					line.push_back(c);
+					// Do not let a line without end grow without limit.
+					if (line.size() >= maxLineLength) {
+						writeLine();
+					}
+				}
+				return ch;
+			}
+
+		  private:
+			static const size_t maxLineLength = 4096;
+
+			void writeLine() {
+				writeLine(line);
+				line.clear();
+			}
+
+			std::ostream &lOut;
+			std::mutex &lOutLock;
+			std::string lPrefix;
+			std::string line;
+		};
+
+		// Interval for progress reports of a job.
+		const std::chrono::seconds progressInterval(30);
+	}
+
+	ResourceBudget::ResourceBudget(unsigned connectionsPerHost, size_t memoryBytes) :
+		lConnectionsPerHost(connectionsPerHost),
+		lMemoryBytes(memoryBytes) {
+	}
+
+	void ResourceBudget::acquireConnections(const std::string &host, unsigned count) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (lConnectionsPerHost != 0) {
+			count = std::min(count, lConnectionsPerHost);
+			released.wait(guard, [&] { return connectionsInUse[host] + count <= lConnectionsPerHost; });
+		}
+		connectionsInUse[host] += count;
+	}
+
+	unsigned ResourceBudget::tryAcquireConnections(const std::string &host, unsigned count) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (lConnectionsPerHost != 0) {
+			unsigned inUse = connectionsInUse[host];
+			count = (inUse < lConnectionsPerHost) ? std::min(count, lConnectionsPerHost - inUse) : 0;
+		}
+		connectionsInUse[host] += count;
+		return count;
+	}
+
+	void ResourceBudget::releaseConnections(const std::string &host, unsigned count) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (lConnectionsPerHost != 0) {
+				count = std::min(count, lConnectionsPerHost);
+			}
+			connectionsInUse[host] -= count;
+		}
+		released.notify_all();
+	}
+
+	size_t ResourceBudget::acquireMemory(size_t bytes) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (lMemoryBytes != 0) {
+			bytes = std::min(bytes, lMemoryBytes);
+			released.wait(guard, [&] { return memoryInUse + bytes <= lMemoryBytes; });
+		}
+		memoryInUse += bytes;
+		return bytes;
+	}
+
+	void ResourceBudget::releaseMemory(size_t bytes) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			memoryInUse -= bytes;
+		}
+		released.notify_all();
+	}
+
+	MemoryReservation::MemoryReservation(ResourceBudget *budget, size_t bytes) :
+		lBudget(budget) {
+		if (lBudget != nullptr) {
+			lBytes = lBudget->acquireMemory(bytes);
+		}
+	}
+
+	MemoryReservation::~MemoryReservation() {
+		if (lBudget != nullptr) {
+			lBudget->releaseMemory(lBytes);
+		}
+	}
+
+	std::vector<BatchResult> runBatch(std::vector<BatchJob> &jobs, unsigned writers, ResourceBudget &budget, std::ostream &out) {
+		std::vector<BatchResult> results(jobs.size());
+		std::atomic<size_t> nextJob(0);
+		std::mutex outLock;
+
+		auto worker = [&] {
+			for (size_t jobNo = nextJob++; jobNo < jobs.size(); jobNo = nextJob++) {
+				BatchJob &job = jobs[jobNo];
+				JobOutputBuffer logBuffer(out, outLock, "[job " + std::to_string(jobNo + 1) + "] ");
+				std::ostream log(&logBuffer);
+				job.options.out = &log;
+				job.options.err = &log;
+				job.options.budget = &budget;
+				bool reportProgress = !job.options.onProgress;
+				if (reportProgress) {
+					// Instead of the dropped progress lines, report now and then.
+					auto lastReport = std::chrono::steady_clock::now();
+					job.options.onProgress = [&logBuffer, lastReport](const std::string &tableName, long long rowsDone, long long rowsTotal) mutable {
+						auto now = std::chrono::steady_clock::now();
+						if (now - lastReport >= progressInterval) {
+							lastReport = now;
+							logBuffer.writeLine(tableName + ": inserting row " + std::to_string(rowsDone) + "/" + std::to_string(rowsTotal));
+						}
+					};
+				}
+				{
+					std::lock_guard<std::mutex> guard(outLock);
+					out << "Starting job " << jobNo + 1 << "/" << jobs.size() << ": "
+					    << job.options.dbName << " -> " << job.sqliteFilename << std::endl;
+				}
+
+				Exporter exporter(job.options);
+				BatchResult &result = results[jobNo];
+				result.success = exporter.exportTo(job.sqliteFilename);
+				if (result.success && job.verify) {
+					result.success = exporter.verify(job.sqliteFilename, job.verifyThreads);
+				}
+				result.error = exporter.lastError();
+				// Messages from libpq end with a newline.
+				while (!result.error.empty() && (result.error.back() == '\n')) {
+					result.error.pop_back();
+				}
+				result.metrics = exporter.metrics();
+				exporter.disconnect();
+
+				log.flush();
+				// Options of the job must not refer to the stream and buffer of this iteration.
+				job.options.out = &std::cout;
+				job.options.err = &std::cerr;
+				if (reportProgress) {
+					job.options.onProgress = nullptr;
+				}
+
+				std::lock_guard<std::mutex> guard(outLock);
+				if (result.success) {
+					out << "===== Job " << jobNo + 1 << " done: " << result.metrics.tablesExported << " tables, "
+					    << result.metrics.rowsExported << " rows in " << result.metrics.seconds << " s =====" << std::endl;
+				} else {
+					out << "===== Job " << jobNo + 1 << " FAILED =====" << std::endl;
+				}
+			}
+		};
+
+		size_t threadCount = (writers == 0) ? jobs.size() : std::min<size_t>(writers, jobs.size());
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadCount; i++) {
+			threads.emplace_back(worker);
+		}
+		for (auto & thread : threads) {
+			thread.join();
+		}
+		return results;
+	}
+
+} // namespace pgToSqlite
@@ -0,0 +1,98 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_BATCH_H
+#define PGTOSQLITE_BATCH_H
+
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "exporter.h"
+
+namespace pgToSqlite {
+
+	// Limits shared by concurrent exports. Exporters take from it when ExportOptions::budget is set.
+	class ResourceBudget {
+	  public:
+		// 0 means unlimited.
+		ResourceBudget(unsigned connectionsPerHost, size_t memoryBytes);
+
+		ResourceBudget(const ResourceBudget &) = delete;
+		ResourceBudget &operator=(const ResourceBudget &) = delete;
+
+		// Blocks until count connections to host are available.
+		void acquireConnections(const std::string &host, unsigned count);
+		// Takes up to count connections to host that are available right now and returns how many.
+		unsigned tryAcquireConnections(const std::string &host, unsigned count);
+		void releaseConnections(const std::string &host, unsigned count);
+
+		// Blocks until bytes of memory are available and returns the amount reserved.
+		// Requests larger than the whole budget are reduced to it, so they run alone instead of never.
+		size_t acquireMemory(size_t bytes);
+		void releaseMemory(size_t bytes);
+
+	  private:
+		std::mutex lock;
+		std::condition_variable released;
+
+		unsigned lConnectionsPerHost;
+		size_t lMemoryBytes;
+
+		std::map<std::string, unsigned> connectionsInUse;
+		size_t memoryInUse = 0;
+	};
+
+	// Holds memory of a budget until destroyed, does nothing without a budget.
+	class MemoryReservation {
+	  public:
+		MemoryReservation(ResourceBudget *budget, size_t bytes);
+		~MemoryReservation();
+
+		MemoryReservation(const MemoryReservation &) = delete;
+		MemoryReservation &operator=(const MemoryReservation &) = delete;
+
+	  private:
+		ResourceBudget *lBudget;
+		size_t lBytes = 0;
+	};
+
+	// A single export of a batch. The output streams and the budget of its options are set by runBatch().
+	struct BatchJob {
+		ExportOptions options;
+		std::string sqliteFilename;
+		// Verify the SQLite3-DB after the export, see Exporter::verify().
+		bool verify = false;
+		unsigned verifyThreads = 0;
+	};
+
+	struct BatchResult {
+		bool success = false;
+		std::string error;
+		ExportMetrics metrics;
+	};
+
+	// Runs the jobs with up to writers of them at once (0 = all), sharing budget.
+	// The output of the jobs is written to out line by line, prefixed with the job number.
+	// Progress lines meant to be overwritten are replaced by a report every 30 seconds.
+	// Returns the results in the order of jobs.
+	std::vector<BatchResult> runBatch(std::vector<BatchJob> &jobs, unsigned writers, ResourceBudget &budget, std::ostream &out);
+
+} // namespace pgToSqlite
+
+#endif
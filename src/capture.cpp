@@ -0,0 +1,641 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "capture.h"
+
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace pgToSqlite {
+
+	namespace {
+		const char captureMagic[8] = {'p', 'g', 'T', 'o', 'S', 'q', 'l', 'C'};
+		const uint32_t captureVersion = 3;
+		// Version 1 lacks the column types in table definitions, version 2 the views.
+		const uint32_t oldestCaptureVersion = 1;
+		const uint32_t flagStatsFromPostgres = 1;
+
+		enum RecordType : uint8_t {
+			TableBeginRecord = 1,
+			RowsRecord = 2,
+			TableEndRecord = 3,
+			IndexRecord = 4
+		};
+
+		const size_t headerSize = sizeof(captureMagic) + 2 * sizeof(uint32_t);
+		const size_t recordHeaderSize = sizeof(uint8_t) + sizeof(uint64_t);
+		const size_t footerSize = sizeof(uint64_t) + sizeof(captureMagic);
+
+		// Rows are collected into records of about this size.
+		const size_t rowChunkSize = 1024 * 1024;
+
+		void putUint32(std::string &buffer, uint32_t value) {
+			for (int i = 0; i < 4; i++) {
+				buffer.push_back(static_cast<char>(value >> (8 * i)));
+			}
+		}
+		void putUint64(std::string &buffer, uint64_t value) {
+			for (int i = 0; i < 8; i++) {
+				buffer.push_back(static_cast<char>(value >> (8 * i)));
+			}
+		}
+		void putVarint(std::string &buffer, uint64_t value) {
+			while (value >= 0x80) {
+				buffer.push_back(static_cast<char>(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<char>(value));
+		}
+		void putString(std::string &buffer, const std::string &value) {
+			putVarint(buffer, value.size());
+			buffer.append(value);
+		}
+		void putStrings(std::string &buffer, const std::vector<std::string> &values) {
+			putVarint(buffer, values.size());
+			for (const auto & value : values) {
+				putString(buffer, value);
+			}
+		}
+
+		// Bounds-checked reading from the mapped file. After reading past the end, ok() is false
+		// and all further reads return zeroes.
+		class Cursor {
+		  public:
+			Cursor(const unsigned char *begin, const unsigned char *end) :
+				pos(begin),
+				end(end) {
+			}
+			bool ok() const {
+				return good;
+			}
+			const char *getBytes(uint64_t count) {
+				if (!good || pos > end || count > static_cast<uint64_t>(end - pos)) {
+					good = false;
+					return nullptr;
+				}
+				const char *bytes = reinterpret_cast<const char *>(pos);
+				pos += count;
+				return bytes;
+			}
+			uint64_t getFixed(int bytes) {
+				const char *raw = getBytes(bytes);
+				uint64_t value = 0;
+				for (int i = 0; raw != nullptr && i < bytes; i++) {
+					value |= static_cast<uint64_t>(static_cast<unsigned char>(raw[i])) << (8 * i);
+				}
+				return value;
+			}
+			uint8_t getUint8() {
+				return getFixed(1);
+			}
+			uint32_t getUint32() {
+				return getFixed(4);
+			}
+			uint64_t getUint64() {
+				return getFixed(8);
+			}
+			uint64_t getVarint() {
+				uint64_t value = 0;
+				for (int shift = 0; shift < 64; shift += 7) {
+					const char *raw = getBytes(1);
+					if (raw == nullptr) {
+						return 0;
+					}
+					value |= static_cast<uint64_t>(*raw & 0x7f) << shift;
+					if ((*raw & 0x80) == 0) {
+						return value;
+					}
+				}
+				good = false;
+				return 0;
+			}
+			std::string getString() {
+				uint64_t length = getVarint();
+				const char *raw = getBytes(length);
+				return (raw != nullptr) ? std::string(raw, length) : std::string();
+			}
+			std::vector<std::string> getStrings() {
+				std::vector<std::string> values;
+				uint64_t count = getVarint();
+				for (uint64_t i = 0; good && i < count; i++) {
+					values.push_back(getString());
+				}
+				return values;
+			}
+		  private:
+			const unsigned char *pos;
+			const unsigned char *end;
+			bool good = true;
+		};
+	}
+
+	CaptureWriter::CaptureWriter(const std::string &captureFilename, bool statsFromPostgres) :
+		lFilename(captureFilename),
+		lStatsFromPostgres(statsFromPostgres) {
+	}
+
+	CaptureWriter::~CaptureWriter() {
+		if (file != nullptr) {
+			finish(false);
+		}
+	}
+
+	bool CaptureWriter::open() {
+		int fd = ::open(lFilename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			if (errno == EEXIST) {
+				lLastError = "File " + lFilename + " already exists! Will not delete it and stop here.";
+			} else {
+				lLastError = "Can't create capture file " + lFilename + ": " + strerror(errno);
+			}
+			return false;
+		}
+		file = fdopen(fd, "wb");
+		if (file == nullptr) {
+			lLastError = "Can't create capture file " + lFilename + ": " + strerror(errno);
+			::close(fd);
+			return false;
+		}
+		setvbuf(file, nullptr, _IOFBF, rowChunkSize);
+
+		std::string header(captureMagic, sizeof(captureMagic));
+		putUint32(header, captureVersion);
+		putUint32(header, lStatsFromPostgres ? flagStatsFromPostgres : 0);
+		if (fwrite(header.data(), 1, header.size(), file) != header.size()) {
+			lLastError = "Error writing capture file " + lFilename + ": " + strerror(errno);
+			return false;
+		}
+		offset = header.size();
+		return true;
+	}
+
+	bool CaptureWriter::writeRecord(uint8_t type, const std::string &payload) {
+		std::string header(1, static_cast<char>(type));
+		putUint64(header, payload.size());
+		if ((fwrite(header.data(), 1, header.size(), file) != header.size()) ||
+		    (fwrite(payload.data(), 1, payload.size(), file) != payload.size())) {
+			lLastError = "Error writing capture file " + lFilename + ": " + strerror(errno);
+			return false;
+		}
+		offset += header.size() + payload.size();
+		return true;
+	}
+
+	bool CaptureWriter::flushRows() {
+		if (rowsInBuffer == 0) {
+			return true;
+		}
+		std::string header(1, static_cast<char>(RowsRecord));
+		putUint64(header, 2 * sizeof(uint32_t) + rowBuffer.size());
+		putUint32(header, index.size() - 1);
+		putUint32(header, rowsInBuffer);
+		if ((fwrite(header.data(), 1, header.size(), file) != header.size()) ||
+		    (fwrite(rowBuffer.data(), 1, rowBuffer.size(), file) != rowBuffer.size())) {
+			lLastError = "Error writing capture file " + lFilename + ": " + strerror(errno);
+			return false;
+		}
+		index.back().chunks.push_back(std::make_pair(offset, rowsInBuffer));
+		offset += header.size() + rowBuffer.size();
+		rowBuffer.clear();
+		rowsInBuffer = 0;
+		return true;
+	}
+
+	TableSink::Result CaptureWriter::beginTable(const TableDefinition &table) {
+		index.push_back(TableIndex());
+		index.back().beginOffset = offset;
+
+		std::string payload;
+		putString(payload, table.name);
+		putStrings(payload, table.columnNames);
+		putString(payload, table.createQuery);
+		putStrings(payload, table.triggerQueries);
+		putStrings(payload, table.indexQueries);
+		putStrings(payload, table.columnTypes);
+		putStrings(payload, table.sourceTypes);
+		payload.push_back(table.strict ? 1 : 0);
+		putStrings(payload, table.viewQueries);
+		return writeRecord(TableBeginRecord, payload) ? Result::Ok : Result::Error;
+	}
+
+	bool CaptureWriter::writeStreamedRow(const std::vector<FieldValue> &row) {
+		if (!flushRows()) {
+			return false;
+		}
+		// Everything but the blob contents, which are appended while writing.
+		std::vector<std::string> fieldHeaders(row.size());
+		uint64_t payloadSize = 2 * sizeof(uint32_t);
+		for (size_t j = 0; j < row.size(); j++) {
+			const FieldValue &field = row[j];
+			FieldValue::Kind kind = (field.kind == FieldValue::StreamedBlob) ? FieldValue::Blob : field.kind;
+			fieldHeaders[j].push_back(static_cast<char>(kind));
+			if (kind != FieldValue::Null) {
+				putVarint(fieldHeaders[j], field.size);
+			}
+			payloadSize += fieldHeaders[j].size() + field.size;
+		}
+
+		std::string header(1, static_cast<char>(RowsRecord));
+		putUint64(header, payloadSize);
+		putUint32(header, index.size() - 1);
+		putUint32(header, 1);
+		bool ok = (fwrite(header.data(), 1, header.size(), file) == header.size());
+		for (size_t j = 0; ok && j < row.size(); j++) {
+			const FieldValue &field = row[j];
+			ok = (fwrite(fieldHeaders[j].data(), 1, fieldHeaders[j].size(), file) == fieldHeaders[j].size());
+			if (ok && field.kind == FieldValue::StreamedBlob) {
+				blobBuffer.resize(blobChunkSize);
+				size_t written = 0;
+				while (written < field.size) {
+					long long readBytes = field.source->read(blobBuffer.data(), std::min(blobChunkSize, field.size - written));
+					if (readBytes <= 0) {
+						lLastError = "Expected " + std::to_string(field.size) + " bytes for streamed blob, got " + std::to_string(written) + "!";
+						return false;
+					}
+					if (fwrite(blobBuffer.data(), 1, readBytes, file) != static_cast<size_t>(readBytes)) {
+						ok = false;
+						break;
+					}
+					written += readBytes;
+				}
+			} else if (ok && field.kind != FieldValue::Null) {
+				ok = (fwrite(field.data, 1, field.size, file) == field.size);
+			}
+		}
+		if (!ok) {
+			lLastError = "Error writing capture file " + lFilename + ": " + strerror(errno);
+			return false;
+		}
+		index.back().chunks.push_back(std::make_pair(offset, 1));
+		offset += header.size() + payloadSize - 2 * sizeof(uint32_t);
+		return true;
+	}
+
+	bool CaptureWriter::writeRow(const std::vector<FieldValue> &row) {
+		for (const auto & field : row) {
+			if (field.kind == FieldValue::StreamedBlob) {
+				return writeStreamedRow(row);
+			}
+		}
+		for (const auto & field : row) {
+			rowBuffer.push_back(static_cast<char>(field.kind));
+			if (field.kind != FieldValue::Null) {
+				putVarint(rowBuffer, field.size);
+				rowBuffer.append(field.data, field.size);
+			}
+		}
+		rowsInBuffer++;
+		if (rowBuffer.size() >= rowChunkSize) {
+			return flushRows();
+		}
+		return true;
+	}
+
+	bool CaptureWriter::endTable(const TableStatistics &statistics) {
+		if (!flushRows()) {
+			return false;
+		}
+		index.back().endOffset = offset;
+
+		std::string payload;
+		putUint32(payload, index.size() - 1);
+		payload.push_back(statistics.needsAnalyze ? 1 : 0);
+		putVarint(payload, statistics.rows.size());
+		for (const auto & statRow : statistics.rows) {
+			putString(payload, statRow.first);
+			putString(payload, statRow.second);
+		}
+		return writeRecord(TableEndRecord, payload);
+	}
+
+	bool CaptureWriter::finish(bool success) {
+		if (file == nullptr) {
+			return success;
+		}
+		if (success) {
+			std::string payload;
+			putUint32(payload, index.size());
+			for (const auto & table : index) {
+				putUint64(payload, table.beginOffset);
+				putUint64(payload, table.endOffset);
+				putUint32(payload, table.chunks.size());
+				for (const auto & chunk : table.chunks) {
+					putUint64(payload, chunk.first);
+					putUint32(payload, chunk.second);
+				}
+			}
+			uint64_t indexOffset = offset;
+			success = writeRecord(IndexRecord, payload);
+			if (success) {
+				std::string footer;
+				putUint64(footer, indexOffset);
+				footer.append(captureMagic, sizeof(captureMagic));
+				if (fwrite(footer.data(), 1, footer.size(), file) != footer.size()) {
+					lLastError = "Error writing capture file " + lFilename + ": " + strerror(errno);
+					success = false;
+				}
+			}
+		}
+		if (fclose(file) != 0 && success) {
+			lLastError = "Error writing capture file " + lFilename + ": " + strerror(errno);
+			success = false;
+		}
+		file = nullptr;
+		return success;
+	}
+
+	CaptureReader::CaptureReader() {
+	}
+
+	CaptureReader::~CaptureReader() {
+		if (data != nullptr) {
+			munmap(const_cast<unsigned char *>(data), size);
+		}
+	}
+
+	bool CaptureReader::fail(const std::string &message) {
+		lLastError = message;
+		return false;
+	}
+
+	bool CaptureReader::statsFromPostgres() const {
+		return (flags & flagStatsFromPostgres) != 0;
+	}
+
+	bool CaptureReader::open(const std::string &captureFilename) {
+		int fd = ::open(captureFilename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return fail("Can't open capture file " + captureFilename + ": " + strerror(errno));
+		}
+		struct stat buffer;
+		if (fstat(fd, &buffer) != 0) {
+			::close(fd);
+			return fail("Can't stat capture file " + captureFilename + ": " + strerror(errno));
+		}
+		size = buffer.st_size;
+		if (size < headerSize) {
+			::close(fd);
+			return fail("File " + captureFilename + " is too short to be a capture file!");
+		}
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapped == MAP_FAILED) {
+			return fail("Can't map capture file " + captureFilename + ": " + strerror(errno));
+		}
+		data = static_cast<const unsigned char *>(mapped);
+		madvise(mapped, size, MADV_SEQUENTIAL);
+
+		Cursor header(data, data + headerSize);
+		if (memcmp(header.getBytes(sizeof(captureMagic)), captureMagic, sizeof(captureMagic)) != 0) {
+			return fail("File " + captureFilename + " is not a capture file!");
+		}
+		version = header.getUint32();
+		if (version < oldestCaptureVersion || version > captureVersion) {
+			return fail("Capture file " + captureFilename + " has unsupported version " + std::to_string(version) + "!");
+		}
+		flags = header.getUint32();
+
+		lLastError.clear();
+		lComplete = readIndex();
+		if (!lComplete) {
+			// An index pointing outside of the file is corrupt, a missing one is from an interrupted capture.
+			if (!lLastError.empty()) {
+				return false;
+			}
+			return scanRecords();
+		}
+		return true;
+	}
+
+	bool CaptureReader::recordBounds(uint64_t offset, uint64_t limit, uint64_t &payloadSize) const {
+		if (limit > size || offset > limit || recordHeaderSize > limit - offset) {
+			return false;
+		}
+		Cursor record(data + offset, data + limit);
+		record.getUint8();
+		payloadSize = record.getUint64();
+		return payloadSize <= limit - offset - recordHeaderSize;
+	}
+
+	bool CaptureReader::readIndex() {
+		if (size < headerSize + footerSize ||
+		    memcmp(data + size - sizeof(captureMagic), captureMagic, sizeof(captureMagic)) != 0) {
+			return false;
+		}
+		Cursor footer(data + size - footerSize, data + size);
+		uint64_t indexOffset = footer.getUint64();
+		if (indexOffset < headerSize || indexOffset > size - footerSize) {
+			return false;
+		}
+		uint64_t indexSize = 0;
+		if (data[indexOffset] != IndexRecord) {
+			return false;
+		}
+		if (!recordBounds(indexOffset, size - footerSize, indexSize)) {
+			return fail("Capture file is corrupt, index record exceeds the file!");
+		}
+		Cursor record(data + indexOffset + recordHeaderSize, data + indexOffset + recordHeaderSize + indexSize);
+		tables.clear();
+		uint64_t payloadSize = 0;
+		uint32_t tableCount = record.getUint32();
+		for (uint32_t tb = 0; record.ok() && tb < tableCount; tb++) {
+			TableIndex table;
+			table.beginOffset = record.getUint64();
+			table.endOffset = record.getUint64();
+			uint32_t chunkCount = record.getUint32();
+			for (uint32_t chunk = 0; record.ok() && chunk < chunkCount; chunk++) {
+				table.chunkOffsets.push_back(record.getUint64());
+				record.getUint32();
+			}
+			if (!record.ok()) {
+				break;
+			}
+			// All records of the table have to lie completely before the index.
+			bool inside = recordBounds(table.beginOffset, indexOffset, payloadSize) && (table.beginOffset >= headerSize) &&
+			              recordBounds(table.endOffset, indexOffset, payloadSize) && (table.endOffset >= headerSize);
+			for (auto chunkOffset : table.chunkOffsets) {
+				inside = inside && recordBounds(chunkOffset, indexOffset, payloadSize) && (chunkOffset >= headerSize);
+			}
+			if (!inside) {
+				return fail("Capture file is corrupt, index of table " + std::to_string(tb) + " points outside of the file!");
+			}
+			tables.push_back(table);
+		}
+		if (!record.ok()) {
+			return fail("Capture file is corrupt, can't read the index!");
+		}
+		return true;
+	}
+
+	bool CaptureReader::scanRecords() {
+		tables.clear();
+		uint64_t pos = headerSize;
+		while (pos + recordHeaderSize <= size) {
+			Cursor record(data + pos, data + size);
+			uint8_t type = record.getUint8();
+			uint64_t payloadSize = record.getUint64();
+			if (payloadSize > size - pos - recordHeaderSize) {
+				// Truncated record at the end.
+				break;
+			}
+			if (type == TableBeginRecord) {
+				tables.push_back(TableIndex());
+				tables.back().beginOffset = pos;
+			} else if (type == RowsRecord || type == TableEndRecord) {
+				uint32_t tableNumber = record.getUint32();
+				if (tableNumber + 1 != tables.size()) {
+					return fail("Capture file is corrupt, records of table " + std::to_string(tableNumber) + " out of order!");
+				}
+				if (type == RowsRecord) {
+					tables.back().chunkOffsets.push_back(pos);
+				} else {
+					tables.back().endOffset = pos;
+				}
+			} else {
+				break;
+			}
+			pos += recordHeaderSize + payloadSize;
+		}
+		// Only tables which were completely captured can be replayed.
+		while (!tables.empty() && tables.back().endOffset == 0) {
+			tables.pop_back();
+		}
+		return true;
+	}
+
+	bool CaptureReader::replay(TableSink &sink, long long &rowCount) {
+		rowCount = 0;
+		if (!sink.open()) {
+			return fail(sink.lastError());
+		}
+		std::vector<FieldValue> row;
+		uint64_t payloadSize = 0;
+		for (const auto & table : tables) {
+			if (!recordBounds(table.beginOffset, size, payloadSize)) {
+				sink.finish(false);
+				return fail("Capture file is corrupt, table definition at offset " + std::to_string(table.beginOffset) + " exceeds the file!");
+			}
+			Cursor begin(data + table.beginOffset + recordHeaderSize, data + table.beginOffset + recordHeaderSize + payloadSize);
+			TableDefinition definition;
+			definition.name = begin.getString();
+			definition.columnNames = begin.getStrings();
+			definition.createQuery = begin.getString();
+			definition.triggerQueries = begin.getStrings();
+			definition.indexQueries = begin.getStrings();
+			if (version >= 2) {
+				definition.columnTypes = begin.getStrings();
+				definition.sourceTypes = begin.getStrings();
+				definition.strict = (begin.getUint8() != 0);
+			}
+			if (version >= 3) {
+				definition.viewQueries = begin.getStrings();
+			}
+			if (!begin.ok()) {
+				sink.finish(false);
+				return fail("Capture file is corrupt, can't read table definition at offset " + std::to_string(table.beginOffset) + "!");
+			}
+
+			TableSink::Result result = sink.beginTable(definition);
+			if (result == TableSink::Result::Error) {
+				sink.finish(false);
+				return fail(sink.lastError());
+			} else if (result == TableSink::Result::SkipTable) {
+				continue;
+			}
+
+			row.resize(definition.columnNames.size());
+			for (auto chunkOffset : table.chunkOffsets) {
+				if (!recordBounds(chunkOffset, size, payloadSize)) {
+					sink.finish(false);
+					return fail("Capture file is corrupt, rows at offset " + std::to_string(chunkOffset) + " exceed the file!");
+				}
+				Cursor chunk(data + chunkOffset + recordHeaderSize, data + chunkOffset + recordHeaderSize + payloadSize);
+				chunk.getUint32();
+				uint32_t rowsInChunk = chunk.getUint32();
+				for (uint32_t i = 0; chunk.ok() && i < rowsInChunk; i++) {
+					bool validKinds = true;
+					for (auto & field : row) {
+						uint8_t kind = chunk.getUint8();
+						// Streamed blobs are stored as Blob, so they can not appear here either.
+						if ((kind > FieldValue::Real) || (kind == FieldValue::StreamedBlob)) {
+							validKinds = false;
+							break;
+						}
+						field.kind = static_cast<FieldValue::Kind>(kind);
+						field.source = nullptr;
+						if (field.kind == FieldValue::Null) {
+							field.data = nullptr;
+							field.size = 0;
+						} else {
+							field.size = chunk.getVarint();
+							field.data = chunk.getBytes(field.size);
+						}
+					}
+					if (!validKinds) {
+						sink.finish(false);
+						return fail("Capture file is corrupt, invalid value in rows at offset " + std::to_string(chunkOffset) + "!");
+					}
+					if (!chunk.ok()) {
+						break;
+					}
+					if (!sink.writeRow(row)) {
+						sink.finish(false);
+						return fail(sink.lastError());
+					}
+					rowCount++;
+				}
+				if (!chunk.ok()) {
+					sink.finish(false);
+					return fail("Capture file is corrupt, can't read rows at offset " + std::to_string(chunkOffset) + "!");
+				}
+			}
+
+			if (!recordBounds(table.endOffset, size, payloadSize)) {
+				sink.finish(false);
+				return fail("Capture file is corrupt, table statistics at offset " + std::to_string(table.endOffset) + " exceed the file!");
+			}
+			Cursor end(data + table.endOffset + recordHeaderSize, data + table.endOffset + recordHeaderSize + payloadSize);
+			end.getUint32();
+			TableStatistics statistics;
+			statistics.needsAnalyze = (end.getUint8() != 0);
+			uint64_t statCount = end.getVarint();
+			for (uint64_t i = 0; end.ok() && i < statCount; i++) {
+				std::string indexName = end.getString();
+				statistics.rows.push_back(std::make_pair(indexName, end.getString()));
+			}
+			if (!end.ok()) {
+				sink.finish(false);
+				return fail("Capture file is corrupt, can't read table statistics at offset " + std::to_string(table.endOffset) + "!");
+			}
+			if (!sink.endTable(statistics)) {
+				sink.finish(false);
+				return fail(sink.lastError());
+			}
+		}
+		if (!sink.finish(true)) {
+			return fail(sink.lastError());
+		}
+		return true;
+	}
+
+} // namespace pgToSqlite
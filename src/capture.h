@@ -0,0 +1,132 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_CAPTURE_H
+#define PGTOSQLITE_CAPTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "tableSink.h"
+
+// Capture files hold everything an export fetched from PostgreSQL, so the SQLite database
+// can be built later without access to the server.
+//
+// Layout (all integers little-endian):
+//   header:  magic "pgToSqlC", uint32 version, uint32 flags (bit 0: statistics from PostgreSQL)
+//   records: uint8 type, uint64 payload size, payload
+//            TableBegin: table definition (since version 2 with column types and STRICT flag, since 3 with views)
+//            Rows:       uint32 table number, uint32 row count, rows
+//                        (per field: uint8 kind, unless Null followed by varint size and data;
+//                        streamed blobs are stored as Blob)
+//            TableEnd:   uint32 table number, uint8 needsAnalyze, sqlite_stat1 rows
+//            Index:      per table the offsets of its TableBegin, Rows and TableEnd records
+//   footer:  uint64 offset of the Index record, magic
+// Strings are stored as varint size and data. Records are only appended, an interrupted
+// capture lacks the index and footer and can still be replayed up to its last complete table.
+
+namespace pgToSqlite {
+
+	// Writes an export into a capture file.
+	class CaptureWriter : public TableSink {
+	  public:
+		CaptureWriter(const std::string &captureFilename, bool statsFromPostgres);
+		~CaptureWriter() override;
+
+		bool open() override;
+		Result beginTable(const TableDefinition &table) override;
+		bool writeRow(const std::vector<FieldValue> &row) override;
+		bool endTable(const TableStatistics &statistics) override;
+		bool finish(bool success) override;
+
+	  private:
+		struct TableIndex {
+			uint64_t beginOffset = 0;
+			uint64_t endOffset = 0;
+			// Offsets and row counts of the Rows records.
+			std::vector<std::pair<uint64_t, uint32_t>> chunks;
+		};
+
+		bool writeRecord(uint8_t type, const std::string &payload);
+		bool flushRows();
+		// Writes a row with streamed blobs as a record of its own, copying the blobs chunk by chunk.
+		bool writeStreamedRow(const std::vector<FieldValue> &row);
+
+		std::string lFilename;
+		bool lStatsFromPostgres;
+		FILE *file = nullptr;
+		uint64_t offset = 0;
+
+		std::vector<TableIndex> index;
+		std::string rowBuffer;
+		uint32_t rowsInBuffer = 0;
+		std::vector<char> blobBuffer;
+	};
+
+	// Reads a capture file and feeds it into a TableSink.
+	class CaptureReader {
+	  public:
+		CaptureReader();
+		~CaptureReader();
+
+		CaptureReader(const CaptureReader &) = delete;
+		CaptureReader &operator=(const CaptureReader &) = delete;
+
+		// Maps the file and reads its index, or scans the records if the capture was interrupted.
+		bool open(const std::string &captureFilename);
+		// Whether the capture contains sqlite_stat1 rows from PostgreSQL.
+		bool statsFromPostgres() const;
+		// Whether the capture was completed, i.e. has an index.
+		bool complete() const {
+			return lComplete;
+		}
+		size_t tableCount() const {
+			return tables.size();
+		}
+
+		// Replays all tables into sink, including its open() and finish().
+		bool replay(TableSink &sink, long long &rowCount);
+
+		const std::string &lastError() const {
+			return lLastError;
+		}
+
+	  private:
+		struct TableIndex {
+			uint64_t beginOffset = 0;
+			uint64_t endOffset = 0;
+			std::vector<uint64_t> chunkOffsets;
+		};
+
+		bool readIndex();
+		// Whether the record at offset, including its payload of payloadSize bytes, ends before limit.
+		bool recordBounds(uint64_t offset, uint64_t limit, uint64_t &payloadSize) const;
+		bool scanRecords();
+		bool fail(const std::string &message);
+
+		std::string lLastError;
+		const unsigned char *data = nullptr;
+		size_t size = 0;
+		uint32_t version = 0;
+		uint32_t flags = 0;
+		bool lComplete = false;
+		std::vector<TableIndex> tables;
+	};
+
+} // namespace pgToSqlite
+
+#endif
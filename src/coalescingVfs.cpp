@@ -0,0 +1,412 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "coalescingVfs.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+namespace pgToSqlite {
+
+	namespace {
+		struct CoalescingVfs {
+			sqlite3_vfs vfs;
+			sqlite3_vfs *parent;
+			std::string name;
+			size_t bufferSize;
+			bool skipSync;
+		};
+
+		// The file of the parent VFS is placed behind this one.
+		struct CoalescingFile {
+			sqlite3_file base;
+			sqlite3_file *real;
+			const CoalescingVfs *settings;
+			bool mainDB;
+			// Descriptor for writing the buffer. The unix VFS splits larger writes into pieces
+			// below 128 KiB, so they go directly to the file.
+			int fd;
+			// Pending writes, starting at bufferOffset in the file.
+			char *buffer;
+			size_t bufferUsed;
+			sqlite3_int64 bufferOffset;
+			// A sync was skipped, the database still needs one when it is closed.
+			bool syncSkipped;
+		};
+
+		const size_t realFileOffset = (sizeof(CoalescingFile) + 7) & ~static_cast<size_t>(7);
+
+		CoalescingVfs *settingsOf(sqlite3_vfs *vfs) {
+			return static_cast<CoalescingVfs *>(vfs->pAppData);
+		}
+
+		sqlite3_vfs *parentOf(sqlite3_vfs *vfs) {
+			return settingsOf(vfs)->parent;
+		}
+
+		int flushBuffer(CoalescingFile *file) {
+			if (file->bufferUsed == 0) {
+				return SQLITE_OK;
+			}
+			const char *data = file->buffer;
+			size_t left = file->bufferUsed;
+			off_t offset = file->bufferOffset;
+			file->bufferUsed = 0;
+			while (left > 0) {
+				ssize_t written = pwrite(file->fd, data, left, offset);
+				if (written < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					return (errno == ENOSPC) ? SQLITE_FULL : SQLITE_IOERR_WRITE;
+				}
+				if (written == 0) {
+					return SQLITE_FULL;
+				}
+				data += written;
+				left -= written;
+				offset += written;
+			}
+			return SQLITE_OK;
+		}
+
+		// sqlite3_io_methods, passing everything on to the real file after flushing where needed.
+
+		int fileClose(sqlite3_file *pFile) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			int rc = flushBuffer(file);
+			if ((rc == SQLITE_OK) && file->syncSkipped && file->mainDB) {
+				rc = file->real->pMethods->xSync(file->real, SQLITE_SYNC_NORMAL);
+			}
+			// Closing a descriptor drops all locks of the process on the file, which are gone by now anyway.
+			if (file->fd >= 0) {
+				close(file->fd);
+				file->fd = -1;
+			}
+			int closeRc = file->real->pMethods->xClose(file->real);
+			sqlite3_free(file->buffer);
+			file->buffer = nullptr;
+			return (rc != SQLITE_OK) ? rc : closeRc;
+		}
+
+		int fileRead(sqlite3_file *pFile, void *data, int iAmt, sqlite3_int64 iOfst) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			if ((file->bufferUsed > 0) &&
+			    (iOfst < file->bufferOffset + static_cast<sqlite3_int64>(file->bufferUsed)) &&
+			    (iOfst + iAmt > file->bufferOffset)) {
+				int rc = flushBuffer(file);
+				if (rc != SQLITE_OK) {
+					return rc;
+				}
+			}
+			return file->real->pMethods->xRead(file->real, data, iAmt, iOfst);
+		}
+
+		int fileWrite(sqlite3_file *pFile, const void *data, int iAmt, sqlite3_int64 iOfst) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			if (file->buffer == nullptr) {
+				return file->real->pMethods->xWrite(file->real, data, iAmt, iOfst);
+			}
+			size_t bufferSize = file->settings->bufferSize;
+			sqlite3_int64 bufferEnd = file->bufferOffset + file->bufferUsed;
+			if (file->bufferUsed > 0) {
+				if ((iOfst >= file->bufferOffset) && (iOfst + iAmt <= bufferEnd)) {
+					// Page rewritten before it was flushed.
+					memcpy(file->buffer + (iOfst - file->bufferOffset), data, iAmt);
+					return SQLITE_OK;
+				}
+				if ((iOfst == bufferEnd) && (file->bufferUsed + iAmt <= bufferSize)) {
+					memcpy(file->buffer + file->bufferUsed, data, iAmt);
+					file->bufferUsed += iAmt;
+					return SQLITE_OK;
+				}
+			}
+			int rc = flushBuffer(file);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
+			if (static_cast<size_t>(iAmt) >= bufferSize) {
+				return file->real->pMethods->xWrite(file->real, data, iAmt, iOfst);
+			}
+			memcpy(file->buffer, data, iAmt);
+			file->bufferOffset = iOfst;
+			file->bufferUsed = iAmt;
+			return SQLITE_OK;
+		}
+
+		int fileTruncate(sqlite3_file *pFile, sqlite3_int64 size) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			int rc = flushBuffer(file);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
+			return file->real->pMethods->xTruncate(file->real, size);
+		}
+
+		int fileSync(sqlite3_file *pFile, int flags) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			int rc = flushBuffer(file);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
+			if (file->settings->skipSync) {
+				file->syncSkipped = true;
+				return SQLITE_OK;
+			}
+			return file->real->pMethods->xSync(file->real, flags);
+		}
+
+		int fileFileSize(sqlite3_file *pFile, sqlite3_int64 *pSize) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			int rc = flushBuffer(file);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
+			return file->real->pMethods->xFileSize(file->real, pSize);
+		}
+
+		int fileLock(sqlite3_file *pFile, int lockType) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xLock(file->real, lockType);
+		}
+
+		int fileUnlock(sqlite3_file *pFile, int lockType) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			// Others may read the file once the lock is gone.
+			int rc = flushBuffer(file);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
+			return file->real->pMethods->xUnlock(file->real, lockType);
+		}
+
+		int fileCheckReservedLock(sqlite3_file *pFile, int *pResOut) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xCheckReservedLock(file->real, pResOut);
+		}
+
+		int fileFileControl(sqlite3_file *pFile, int op, void *pArg) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xFileControl(file->real, op, pArg);
+		}
+
+		int fileSectorSize(sqlite3_file *pFile) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xSectorSize(file->real);
+		}
+
+		int fileDeviceCharacteristics(sqlite3_file *pFile) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xDeviceCharacteristics(file->real);
+		}
+
+		int fileShmMap(sqlite3_file *pFile, int iPg, int pgsz, int bExtend, void volatile **pp) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xShmMap(file->real, iPg, pgsz, bExtend, pp);
+		}
+
+		int fileShmLock(sqlite3_file *pFile, int offset, int n, int flags) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xShmLock(file->real, offset, n, flags);
+		}
+
+		void fileShmBarrier(sqlite3_file *pFile) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			file->real->pMethods->xShmBarrier(file->real);
+		}
+
+		int fileShmUnmap(sqlite3_file *pFile, int deleteFlag) {
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			return file->real->pMethods->xShmUnmap(file->real, deleteFlag);
+		}
+
+		// Version 2, so SQLite does not memory-map the file and reads always go through fileRead().
+		const sqlite3_io_methods coalescingIoMethods = {
+			2,
+			fileClose,
+			fileRead,
+			fileWrite,
+			fileTruncate,
+			fileSync,
+			fileFileSize,
+			fileLock,
+			fileUnlock,
+			fileCheckReservedLock,
+			fileFileControl,
+			fileSectorSize,
+			fileDeviceCharacteristics,
+			fileShmMap,
+			fileShmLock,
+			fileShmBarrier,
+			fileShmUnmap,
+			nullptr,
+			nullptr
+		};
+
+		// The VFS itself, opening files through the parent and forwarding everything else.
+
+		int vfsOpen(sqlite3_vfs *pVfs, const char *zName, sqlite3_file *pFile, int flags, int *pOutFlags) {
+			const CoalescingVfs *settings = settingsOf(pVfs);
+			CoalescingFile *file = reinterpret_cast<CoalescingFile *>(pFile);
+			memset(file, 0, sizeof(CoalescingFile));
+			file->real = reinterpret_cast<sqlite3_file *>(reinterpret_cast<char *>(pFile) + realFileOffset);
+			file->settings = settings;
+			file->mainDB = ((flags & SQLITE_OPEN_MAIN_DB) != 0);
+			file->fd = -1;
+
+			int rc = settings->parent->xOpen(settings->parent, zName, file->real, flags, pOutFlags);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
+			// Other files stay unbuffered, as do files we can not open a second time.
+			if (((flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_MAIN_JOURNAL)) != 0) && (settings->bufferSize > 0) &&
+			    (zName != nullptr) && ((flags & SQLITE_OPEN_READWRITE) != 0)) {
+				file->fd = open(zName, O_WRONLY | O_CLOEXEC);
+				if (file->fd >= 0) {
+					file->buffer = static_cast<char *>(sqlite3_malloc64(settings->bufferSize));
+					if (file->buffer == nullptr) {
+						close(file->fd);
+						file->real->pMethods->xClose(file->real);
+						return SQLITE_NOMEM;
+					}
+				}
+			}
+			file->base.pMethods = &coalescingIoMethods;
+			return SQLITE_OK;
+		}
+
+		int vfsDelete(sqlite3_vfs *pVfs, const char *zName, int syncDir) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xDelete(parent, zName, settingsOf(pVfs)->skipSync ? 0 : syncDir);
+		}
+
+		int vfsAccess(sqlite3_vfs *pVfs, const char *zName, int flags, int *pResOut) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xAccess(parent, zName, flags, pResOut);
+		}
+
+		int vfsFullPathname(sqlite3_vfs *pVfs, const char *zName, int nOut, char *zOut) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xFullPathname(parent, zName, nOut, zOut);
+		}
+
+		void *vfsDlOpen(sqlite3_vfs *pVfs, const char *zFilename) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xDlOpen(parent, zFilename);
+		}
+
+		void vfsDlError(sqlite3_vfs *pVfs, int nByte, char *zErrMsg) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			parent->xDlError(parent, nByte, zErrMsg);
+		}
+
+		void (*vfsDlSym(sqlite3_vfs *pVfs, void *pHandle, const char *zSymbol))(void) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xDlSym(parent, pHandle, zSymbol);
+		}
+
+		void vfsDlClose(sqlite3_vfs *pVfs, void *pHandle) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			parent->xDlClose(parent, pHandle);
+		}
+
+		int vfsRandomness(sqlite3_vfs *pVfs, int nByte, char *zOut) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xRandomness(parent, nByte, zOut);
+		}
+
+		int vfsSleep(sqlite3_vfs *pVfs, int microseconds) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xSleep(parent, microseconds);
+		}
+
+		int vfsCurrentTime(sqlite3_vfs *pVfs, double *pTime) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xCurrentTime(parent, pTime);
+		}
+
+		int vfsGetLastError(sqlite3_vfs *pVfs, int nByte, char *zErrMsg) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xGetLastError(parent, nByte, zErrMsg);
+		}
+
+		int vfsCurrentTimeInt64(sqlite3_vfs *pVfs, sqlite3_int64 *pTime) {
+			sqlite3_vfs *parent = parentOf(pVfs);
+			return parent->xCurrentTimeInt64(parent, pTime);
+		}
+
+		std::mutex registryMutex;
+		std::map<std::string, std::unique_ptr<CoalescingVfs>> registry;
+	}
+
+	const char *coalescingVfsName(size_t bufferSize, bool skipSync) {
+		std::string name = "pgToSqlite-coalescing-" + std::to_string(bufferSize) + (skipSync ? "-nosync" : "-sync");
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto it = registry.find(name);
+		if (it != registry.end()) {
+			return it->second->name.c_str();
+		}
+
+		sqlite3_vfs *parent = sqlite3_vfs_find(nullptr);
+		if ((parent == nullptr) || (parent->iVersion < 2)) {
+			return nullptr;
+		}
+
+		std::unique_ptr<CoalescingVfs> coalescingVfs(new CoalescingVfs());
+		coalescingVfs->parent = parent;
+		coalescingVfs->name = name;
+		coalescingVfs->bufferSize = bufferSize;
+		coalescingVfs->skipSync = skipSync;
+
+		sqlite3_vfs &vfs = coalescingVfs->vfs;
+		vfs.iVersion = 2;
+		vfs.szOsFile = static_cast<int>(realFileOffset) + parent->szOsFile;
+		vfs.mxPathname = parent->mxPathname;
+		vfs.zName = coalescingVfs->name.c_str();
+		vfs.pAppData = coalescingVfs.get();
+		vfs.xOpen = vfsOpen;
+		vfs.xDelete = vfsDelete;
+		vfs.xAccess = vfsAccess;
+		vfs.xFullPathname = vfsFullPathname;
+		vfs.xDlOpen = vfsDlOpen;
+		vfs.xDlError = vfsDlError;
+		vfs.xDlSym = vfsDlSym;
+		vfs.xDlClose = vfsDlClose;
+		vfs.xRandomness = vfsRandomness;
+		vfs.xSleep = vfsSleep;
+		vfs.xCurrentTime = vfsCurrentTime;
+		vfs.xGetLastError = vfsGetLastError;
+		vfs.xCurrentTimeInt64 = vfsCurrentTimeInt64;
+
+		if (sqlite3_vfs_register(&vfs, 0) != SQLITE_OK) {
+			return nullptr;
+		}
+		const char *vfsName = coalescingVfs->name.c_str();
+		registry[name] = std::move(coalescingVfs);
+		return vfsName;
+	}
+
+} // namespace pgToSqlite
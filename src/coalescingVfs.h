@@ -0,0 +1,33 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_COALESCINGVFS_H
+#define PGTOSQLITE_COALESCINGVFS_H
+
+#include <cstddef>
+
+namespace pgToSqlite {
+
+	// Returns the name of a VFS wrapping SQLite's default one, which collects sequential writes
+	// to the main database and its journal in a buffer of bufferSize bytes (0 = no buffering)
+	// and hands them on in one go.
+	// With skipSync, syncs are skipped and the database is synced once when it is closed.
+	// This is only safe for files nobody else uses before they are complete.
+	// A VFS is registered once per setting and stays registered. Returns nullptr on errors.
+	const char *coalescingVfsName(size_t bufferSize, bool skipSync);
+
+} // namespace pgToSqlite
+
+#endif
@@ -0,0 +1,1773 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "exporter.h"
+#include "sqliteWriter.h"
+#include "capture.h"
+#include "batch.h"
+#include "verifier.h"
+
+#include <iomanip>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <arpa/inet.h>
+
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include <set>
+#include <vector>
+#include <cmath>
+#include <climits>
+#include <cerrno>
+
+#include <libpq/libpq-fs.h>
+
+namespace pgToSqlite {
+
+	// Tables larger than this are skipped if ExportOptions::useMaxDumpSize is set.
+	static const long long maxDumpSize = 1024LL * 1024 * 1024;
+
+	// Whether SQLite converts numeric text stored in a column of this declared type to a number,
+	// i.e. the column's affinity is neither TEXT nor BLOB (see 'Determination Of Column Affinity').
+	static bool hasNumericAffinity(std::string declaredType) {
+		std::transform(declaredType.begin(), declaredType.end(), declaredType.begin(), ::toupper);
+		if (declaredType.find("INT") != std::string::npos) {
+			return true;
+		}
+		if ((declaredType.find("CHAR") != std::string::npos) || (declaredType.find("CLOB") != std::string::npos) ||
+		    (declaredType.find("TEXT") != std::string::npos) || (declaredType.find("BLOB") != std::string::npos) ||
+		    declaredType.empty()) {
+			return false;
+		}
+		return true;
+	}
+
+	static const unsigned int boolOid = 16;
+
+	// Declared SQLite type for a PostgreSQL type (given by OID), so the affinity matches what is stored.
+	// Everything without an exact numeric representation in SQLite is stored as text, as PostgreSQL prints it:
+	// numeric only fits into INTEGER without scale and with at most 18 digits (precision 0 = unconstrained).
+	static const char *sqliteTypeForPgType(unsigned int typeOid, int numericPrecision, int numericScale, bool dumpLargeObjects) {
+		switch (typeOid) {
+			case boolOid:
+			case 20:   // bigint
+			case 21:   // smallint
+			case 23:   // integer
+				return "INTEGER";
+			case 26:   // oid, large objects become blobs
+				return dumpLargeObjects ? "BLOB" : "INTEGER";
+			case 700:  // real
+			case 701:  // double precision
+				return "REAL";
+			case 1700: // numeric
+				return ((numericPrecision > 0) && (numericPrecision <= 18) && (numericScale == 0)) ? "INTEGER" : "TEXT";
+			default:
+				return "TEXT";
+		}
+	}
+
+	// Selects a timestamp with time zone or date as seconds / microseconds since the epoch,
+	// with infinities as the largest / smallest 64 bit integer.
+	static std::string epochExpression(const std::string &column, bool microseconds) {
+		std::string seconds = "extract(epoch from date_trunc('second', " + column + "))::bigint";
+		std::string finite = microseconds ? seconds + " * 1000000 + (date_part('microseconds', " + column + ")::bigint % 1000000)" : seconds;
+		return "(CASE WHEN isfinite(" + column + ") THEN " + finite +
+		       " WHEN " + column + " = 'infinity' THEN 9223372036854775807" +
+		       " WHEN " + column + " = '-infinity' THEN -9223372036854775807 - 1 END)::bigint";
+	}
+
+	// SQLite default for a column stored since the epoch, from the default converted for text storage.
+	// Covers infinities and the current time, empty for other defaults. CURRENT_TIMESTAMP is an instant,
+	// so it is 'now' in UTC for columns without time zone as well, as their values are converted back
+	// from the server's local time.
+	static std::string epochDefault(const std::string &textDefault, bool microseconds) {
+		if ((textDefault == "'9999-12-31 12:00:00'") || (textDefault == "'infinity'")) {
+			return "9223372036854775807";
+		}
+		if ((textDefault == "'0000-00-00 12:00:00'") || (textDefault == "'-infinity'")) {
+			return "(-9223372036854775807 - 1)";
+		}
+		std::string timeValue;
+		if (textDefault == "CURRENT_TIMESTAMP") {
+			timeValue = "'now'";
+		} else if (textDefault == "CURRENT_DATE") {
+			timeValue = "'now', 'start of day'";
+		} else {
+			return "";
+		}
+		return "(CAST(strftime('%s', " + timeValue + ") AS INTEGER)" + (microseconds ? " * 1000000" : "") + ")";
+	}
+
+	// SQLite default for a constant default of a column stored since the epoch, evaluated by PostgreSQL
+	// with the same expression as the values. Empty if that fails.
+	static std::string evaluateEpochDefault(PGconn *conn, const std::string &expression) {
+		std::string query = "SELECT " + expression + ";";
+		PGresult *res = PQexec(conn, query.c_str());
+		std::string value;
+		if ((PQresultStatus(res) == PGRES_TUPLES_OK) && (PQntuples(res) == 1) && !PQgetisnull(res, 0, 0)) {
+			value = PQgetvalue(res, 0, 0);
+		}
+		PQclear(res);
+		return value;
+	}
+
+	// Shows a column stored since the epoch as text, as it would have been stored with TimestampStorage::Text:
+	// fractions of seconds only if there are any, without trailing zeros, and dates as plain numbers if infinite.
+	static std::string readableEpoch(const std::string &column, bool isDate, bool microseconds) {
+		std::string value;
+		if (isDate) {
+			value = "date(" + column + (microseconds ? " / 1000000" : "") + ", 'unixepoch')";
+		} else if (microseconds) {
+			// Rounded down, so that times before 1970 get a positive fraction.
+			std::string fraction = "((" + column + " % 1000000 + 1000000) % 1000000)";
+			std::string seconds = "((" + column + " - " + fraction + ") / 1000000)";
+			value = "strftime('%Y-%m-%d %H:%M:%S', " + seconds + ", 'unixepoch') || "
+			        "CASE " + fraction + " WHEN 0 THEN '' ELSE rtrim(printf('.%06d', " + fraction + "), '0') END";
+		} else {
+			value = "datetime(" + column + ", 'unixepoch')";
+		}
+		if (isDate) {
+			return "CASE " + column + " WHEN 9223372036854775807 THEN 9e999"
+			       " WHEN -9223372036854775807 - 1 THEN -9e999 ELSE " + value + " END";
+		}
+		return "CASE " + column + " WHEN 9223372036854775807 THEN '9999-12-31 12:00:00'"
+		       " WHEN -9223372036854775807 - 1 THEN '0000-00-00 12:00:00' ELSE " + value + " END";
+	}
+
+	static std::string getHostFromName(const char *host, std::ostream &out) {
+		struct addrinfo hints, *res;
+		int errcode;
+		char addrstr[100];
+		void *ptr = nullptr;
+
+		memset (&hints, 0, sizeof (hints));
+		hints.ai_family = PF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags |= AI_CANONNAME;
+
+		errcode = getaddrinfo (host, nullptr, &hints, &res);
+		if (errcode != 0)	{
+			out << "getaddrinfo: " << gai_strerror(errcode) << std::endl;
+			std::string ipAddr("localhost");
+			return ipAddr;
+		}
+
+		while (res) {
+			inet_ntop (res->ai_family, res->ai_addr->sa_data, addrstr, 100);
+
+			switch (res->ai_family) {
+				case AF_INET:
+					ptr = &((struct sockaddr_in *) res->ai_addr)->sin_addr;
+					break;
+				case AF_INET6:
+					ptr = &((struct sockaddr_in6 *) res->ai_addr)->sin6_addr;
+					break;
+			}
+			if (ptr == nullptr) {
+				out << "Error during hostname-resolution, defaulting to localhost!" << std::endl;
+				freeaddrinfo(res);
+				std::string ipAddr(addrstr);
+				return ipAddr;
+			}
+			inet_ntop (res->ai_family, ptr, addrstr, 100);
+			out << "Hostname lookup for " << host << " returned: " << std::endl;
+			out << "IPv" << (res->ai_family == PF_INET6 ? 6 : 4) << " address: "
+			    << addrstr << " (" << res->ai_canonname << ")" << std::endl;
+			out << "Taking first result from hostname-lookup!" << std::endl;
+			freeaddrinfo(res);
+			std::string ipAddr(addrstr);
+			return ipAddr;
+		}
+		std::string ipAddr("localhost");
+		return ipAddr;
+	}
+
+	// Builds the 'stat' column of an sqlite_stat1 row for an index from PostgreSQL's n_distinct estimates
+	// (see https://www.sqlite.org/fileformat2.html#stat1tab): the row count, followed by the average number
+	// of rows sharing the same values in the leftmost 1..k columns of the index.
+	// Columns are assumed to be independent. Returns an empty string if any indexed column lacks statistics.
+	static std::string buildIndexStat(long long rowCount, const std::vector<std::string> &indexColumns,
+	                                  const std::map<std::string, double> &nDistinct, bool isUnique) {
+		std::stringstream stat;
+		stat << rowCount;
+		double prefixDistinct = 1;
+		for (size_t col = 0; col < indexColumns.size(); col++) {
+			auto it = nDistinct.find(indexColumns[col]);
+			if (it == nDistinct.end() || it->second == 0) {
+				// 0 means 'unknown' for PostgreSQL.
+				return "";
+			}
+			// Negative values are the negated fraction of distinct values relative to the row count.
+			double colDistinct = (it->second > 0) ? it->second : -it->second * rowCount;
+			prefixDistinct = std::min<double>(rowCount, std::max<double>(1, prefixDistinct * colDistinct));
+			long long rowsPerKey = static_cast<long long>(std::ceil(rowCount / prefixDistinct));
+			if (isUnique && (col == indexColumns.size() - 1)) {
+				rowsPerKey = 1;
+			}
+			stat << " " << rowsPerKey;
+		}
+		return stat.str();
+	}
+
+	// Reads an opened large object for a StreamedBlob.
+	class LargeObjectSource : public BlobSource {
+	  public:
+		PGconn *dbc = nullptr;
+		int fd = -1;
+
+		long long read(char *buffer, size_t size) override {
+			return lo_read(dbc, fd, buffer, size);
+		}
+	};
+
+	static void setText(FieldValue &field, const char *text) {
+		field.kind = FieldValue::Text;
+		field.data = text;
+		field.size = strlen(text);
+	}
+
+	// Builds the sqlite_stat1 rows for a table and its recreated indexes.
+	static TableStatistics buildTableStatistics(long long rowCount,
+	                                            const std::vector<std::string> &indexNames,
+	                                            const std::vector<std::vector<std::string>> &indexColumns,
+	                                            const std::vector<bool> &indexIsUnique,
+	                                            const std::map<std::string, double> &columnNDistinct) {
+		TableStatistics statistics;
+		if (rowCount == 0) {
+			// Like ANALYZE, do not write statistics for empty tables.
+			return statistics;
+		}
+		for (size_t i = 0; i < indexNames.size(); i++) {
+			std::string stat = buildIndexStat(rowCount, indexColumns[i], columnNDistinct, indexIsUnique[i]);
+			if (stat.empty()) {
+				// Either we have PostgreSQL's view on the whole table, or fall back.
+				statistics.rows.clear();
+				statistics.needsAnalyze = true;
+				return statistics;
+			}
+			statistics.rows.push_back(std::make_pair(indexNames[i], stat));
+		}
+		if (indexNames.empty()) {
+			// Just the row count, as ANALYZE does for tables without indexes.
+			statistics.rows.push_back(std::make_pair(std::string(), std::to_string(rowCount)));
+		}
+		return statistics;
+	}
+
+	Exporter::Exporter(const ExportOptions &options) :
+		lOptions(options) {
+	}
+
+	Exporter::~Exporter() {
+		disconnect();
+	}
+
+	bool Exporter::fail(const std::string &message) {
+		lLastError = message;
+		err() << message << std::endl;
+		return false;
+	}
+
+	// Opens a connection and sets its time zone to UTC, because we want to store timestamps in UTC in SQLite, too.
+	// The first dbname is expanded if it is a connection string, later parameters override earlier ones.
+	// Returns nullptr on errors; receive-buffer problems are reported in warning.
+	static PGconn *openConnection(const std::vector<std::pair<std::string, std::string>> &parameters,
+	                              size_t receiveBuffer, std::string &error, std::string &warning) {
+		std::vector<const char *> keywords;
+		std::vector<const char *> values;
+		for (const auto & parameter : parameters) {
+			keywords.push_back(parameter.first.c_str());
+			values.push_back(parameter.second.c_str());
+		}
+		keywords.push_back(nullptr);
+		values.push_back(nullptr);
+
+		PGconn *conn = PQconnectdbParams(keywords.data(), values.data(), 1);
+		if (PQstatus(conn) != CONNECTION_OK) {
+			error = PQerrorMessage(conn);
+			PQfinish(conn);
+			return nullptr;
+		}
+
+		if (receiveBuffer > 0) {
+			// Whole tables are fetched at once, a large buffer keeps the TCP window open on long distances.
+			// Linux allows growing it after the handshake, as the window scale is chosen by the system maximum.
+			struct sockaddr_storage address;
+			socklen_t addressLength = sizeof(address);
+			int fd = PQsocket(conn);
+			if ((getsockname(fd, reinterpret_cast<struct sockaddr *>(&address), &addressLength) == 0) &&
+			    ((address.ss_family == AF_INET) || (address.ss_family == AF_INET6))) {
+				int size = static_cast<int>(std::min<size_t>(receiveBuffer, INT_MAX));
+				int effective = 0;
+				socklen_t effectiveLength = sizeof(effective);
+				if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+					warning = "Could not set the TCP receive buffer to " + std::to_string(size) + " bytes: " + strerror(errno);
+				} else if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &effective, &effectiveLength) == 0) {
+					// Linux doubles the value for its bookkeeping and silently caps it at net.core.rmem_max.
+					if (effective / 2 < size) {
+						warning = "TCP receive buffer is " + std::to_string(effective / 2) + " bytes instead of the requested " +
+						          std::to_string(size) + " (limited by net.core.rmem_max?), receive window autotuning is off.";
+					}
+				}
+			}
+		}
+
+		PGresult* res = PQexec(conn, "SET TIMEZONE TO 'UTC';");
+		if (!(PQresultStatus(res) == PGRES_COMMAND_OK)) {
+			error = PQerrorMessage(conn);
+			PQclear(res);
+			PQfinish(conn);
+			return nullptr;
+		}
+		PQclear(res);
+		return conn;
+	}
+
+	bool Exporter::connect() {
+		if (dbc != nullptr) {
+			if (PQstatus(dbc) == CONNECTION_OK) {
+				return true;
+			}
+			disconnect();
+		}
+
+		// Our defaults come first, so a connection string can override them.
+		connectionParameters.clear();
+		connectionParameters.emplace_back("connect_timeout", "10");
+		if (lOptions.keepaliveIdle > 0) {
+			connectionParameters.emplace_back("keepalives", "1");
+			connectionParameters.emplace_back("keepalives_idle", std::to_string(lOptions.keepaliveIdle));
+			connectionParameters.emplace_back("keepalives_interval", std::to_string(std::max(lOptions.keepaliveIdle / 3, 1u)));
+			connectionParameters.emplace_back("keepalives_count", "3");
+		}
+
+		std::string connectionDescription;
+		std::string server;
+		if (!lOptions.dbConnInfo.empty()) {
+			connectionParameters.emplace_back("dbname", lOptions.dbConnInfo);
+			if (!lOptions.dbName.empty()) {
+				connectionParameters.emplace_back("dbname", lOptions.dbName);
+			}
+			// It may contain a password.
+			connectionDescription = "the given connection info";
+			server = lOptions.dbConnInfo;
+		} else {
+			if (!lOptions.dbSocketDir.empty()) {
+				// libpq takes a host starting with a slash as socket directory.
+				connectionParameters.emplace_back("host", lOptions.dbSocketDir);
+				server = lOptions.dbSocketDir;
+			} else {
+				connectionParameters.emplace_back("hostaddr", getHostFromName(lOptions.dbHost.c_str(), out()));
+				server = lOptions.dbHost;
+			}
+			server += ":" + std::to_string(lOptions.dbPort);
+			connectionParameters.emplace_back("port", std::to_string(lOptions.dbPort));
+			connectionParameters.emplace_back("dbname", lOptions.dbName);
+			connectionParameters.emplace_back("user", lOptions.dbUser);
+			connectionParameters.emplace_back("password", lOptions.dbPassword);
+			// Only the first dbname is expanded if it looks like a connection string, make sure it is this empty one.
+			connectionParameters.emplace(connectionParameters.begin(), "dbname", "");
+		}
+		if (connectionDescription.empty()) {
+			std::stringstream buildDescription;
+			for (const auto & parameter : connectionParameters) {
+				if (parameter.second.empty()) {
+					continue;
+				}
+				buildDescription << (buildDescription.tellp() > 0 ? " " : "") << parameter.first << "='" << parameter.second << "'";
+			}
+			connectionDescription = "\"" + buildDescription.str() + "\"";
+		}
+
+		if (lOptions.budget != nullptr) {
+			connectionBudget = lOptions.budget;
+			budgetHost = server;
+			connectionBudget->acquireConnections(budgetHost, 1);
+		}
+
+		out() << "Connecting to Postgres, using: " << connectionDescription << "... " << std::endl;
+		std::string message;
+		std::string warning;
+		dbc = openConnection(connectionParameters, lOptions.tcpReceiveBuffer, message, warning);
+		if (dbc == nullptr) {
+			disconnect();
+			return fail(message);
+		}
+		if (!warning.empty()) {
+			err() << warning << std::endl;
+		}
+		return true;
+	}
+
+	void Exporter::disconnect() {
+		if (dbc != nullptr) {
+			PQfinish(dbc);
+			dbc = nullptr;
+		}
+		if (connectionBudget != nullptr) {
+			connectionBudget->releaseConnections(budgetHost, 1);
+			connectionBudget = nullptr;
+		}
+		haveLOsizeFun = false;
+		haveVerifyFun = false;
+	}
+
+	bool Exporter::beginPGSQLTransaction() {
+		PGresult* res = PQexec(dbc, "BEGIN");
+		bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+		PQclear(res);
+		return ok ? true : fail(PQerrorMessage(dbc));
+	}
+	bool Exporter::endPGSQLTransaction() {
+		PGresult* res = PQexec(dbc, "COMMIT");
+		bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+		PQclear(res);
+		return ok ? true : fail(PQerrorMessage(dbc));
+	}
+
+	bool Exporter::dropLOsizeFun() {
+		PGresult* res = PQexec(dbc, "DROP FUNCTION IF EXISTS pg_temp.get_lo_size(oid);");
+		bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+		PQclear(res);
+		haveLOsizeFun = false;
+		return ok ? true : fail(PQerrorMessage(dbc));
+	}
+
+	size_t Exporter::getLargeObjectSize(unsigned int oid) {
+		std::string sql_query = "";
+		std::stringstream buildquery;
+
+		if (!haveLOsizeFun) {
+			// Created in the session's temporary schema, so concurrent exports of the same database do not interfere.
+			buildquery << "CREATE OR REPLACE FUNCTION pg_temp.get_lo_size(oid) RETURNS bigint AS $$ "
+			           << "DECLARE \n"
+			           << "    fd integer; \n"
+			           << "    sz bigint; \n"
+			           << "BEGIN \n"
+			           << "    -- Open the LO; N.B. it needs to be in a transaction otherwise it will close immediately. \n"
+			           << "    -- Luckily a function invocation makes its own transaction if necessary. \n"
+			           << "    -- The mode x'40000'::int corresponds to the PostgreSQL LO mode INV_READ = 0x40000. \n"
+			           << "    fd := lo_open($1, x'40000'::int); \n"
+			           << "    -- Seek to the end.  2 = SEEK_END. \n"
+			           << "    PERFORM lo_lseek(fd, 0, 2); \n"
+			           << "    -- Fetch the current file position; since we're at the end, this is the size. \n"
+			           << "    sz := lo_tell(fd); \n"
+			           << "    -- Remember to close it, since the function may be called as part of a larger transaction. \n"
+			           << "    PERFORM lo_close(fd); \n"
+			           << "    -- Return the size. \n"
+			           << "    RETURN sz; \n"
+			           << "END; $$ LANGUAGE 'plpgsql' VOLATILE STRICT; ";
+
+			sql_query = buildquery.str();
+			PGresult* res = PQexec(dbc, sql_query.c_str());
+			if (!((PQresultStatus(res) == PGRES_TUPLES_OK) || (PQresultStatus(res) == PGRES_COMMAND_OK))) {
+				PQclear(res);
+				err() << PQerrorMessage(dbc) << std::endl;
+				return -1;
+			} else {
+				PQclear(res);
+				haveLOsizeFun = true;
+			}
+		}
+
+		buildquery.str("");
+		buildquery.clear();
+		buildquery << "SELECT pg_temp.get_lo_size(" << oid << ");";
+		sql_query = buildquery.str();
+
+		PGresult* res = PQexec(dbc, sql_query.c_str());
+		if (!((PQresultStatus(res) == PGRES_TUPLES_OK) || (PQresultStatus(res) == PGRES_COMMAND_OK))) {
+			PQclear(res);
+			err() << PQerrorMessage(dbc) << std::endl;
+			return -1;
+		} else {
+			size_t lObjSize = atol(PQgetvalue(res, 0, 0));
+			PQclear(res);
+			return lObjSize;
+		}
+		return 0;
+	}
+
+	bool Exporter::exportTo(const std::string &sqliteFilename) {
+		SqliteWriter writer(sqliteFilename, lOptions);
+		return exportInto(writer);
+	}
+
+	bool Exporter::captureTo(const std::string &captureFilename) {
+		CaptureWriter writer(captureFilename, lOptions.statsFromPostgres);
+		return exportInto(writer);
+	}
+
+	bool Exporter::exportInto(TableSink &sink) {
+		auto startTime = std::chrono::steady_clock::now();
+		lMetrics = ExportMetrics();
+		lLastError.clear();
+
+		if (!lOptions.excludeTables.empty()) {
+			out() << "Will exclude the following tables / table patterns from dump:" << std::endl;
+			for (const auto & excludeTable : lOptions.excludeTables) {
+				out() << " - " << excludeTable << std::endl;
+			}
+		}
+
+		if (!connect()) {
+			return false;
+		}
+
+		// Postgres is open, then we can now open the output
+		if (!sink.open()) {
+			return fail(sink.lastError());
+		}
+
+		bool success = exportTables(sink);
+
+		if (PQtransactionStatus(dbc) == PQTRANS_INERROR || PQtransactionStatus(dbc) == PQTRANS_INTRANS) {
+			// Aborted in the middle of a table, make the connection usable for the next export.
+			PGresult* res = PQexec(dbc, "ROLLBACK");
+			PQclear(res);
+		}
+		if (haveLOsizeFun) {
+			success = dropLOsizeFun() && success;
+		}
+
+		if (!sink.finish(success) && success) {
+			success = fail(sink.lastError());
+		}
+
+		lMetrics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		return success;
+	}
+
+	bool Exporter::listTables(std::vector<std::pair<std::string, bool>> &tables) {
+		// Now, request table-names from postgres:
+		std::stringstream buildquery;
+		buildquery << "SELECT "
+		           <<  "   table_name,  "
+		           <<  "   (CASE WHEN table_name::regclass IN (SELECT inhrelid FROM pg_inherits) THEN 1 ELSE 0 END) AS is_child "
+		           <<  " FROM "
+		           <<  "   information_schema.tables "
+		           <<  " WHERE";
+		buildquery <<  "   table_schema NOT IN ('pg_catalog', 'information_schema') ";
+		for (const auto & excludeTable : lOptions.excludeTables) {
+			buildquery << " AND table_name NOT LIKE $dollarQuote$" << excludeTable << "$dollarQuote$ " << std::endl;
+		}
+		buildquery << " ; " << std::endl;
+		PGresult* res = PQexec(dbc, buildquery.str().c_str());
+		if (!((PQresultStatus(res) == PGRES_TUPLES_OK) || (PQresultStatus(res) == PGRES_COMMAND_OK))) {
+			PQclear(res);
+			return fail("Query failed: \n" + buildquery.str() + "\n" + PQerrorMessage(dbc));
+		}
+
+		if (!((PQresultStatus(res) == PGRES_TUPLES_OK) && (PQnfields(res) == 2))) {
+			PQclear(res);
+			out() << std::endl;
+			return fail("Something failed with table-name-selection-query!");
+		}
+
+		for (int tb = 0; tb < PQntuples(res); tb++) { // These are the table-name-rows
+			// Get table name here:
+			std::string tableName = PQgetvalue(res, tb, 0);
+
+			// Is it a child-table?
+			bool isChildTable = (atoi(PQgetvalue(res, tb, 1)) == 1) ? true : false;
+
+			tables.push_back(std::make_pair(tableName, isChildTable));
+		}
+
+		PQclear(res);
+		return true;
+	}
+
+	bool Exporter::exportTables(TableSink &sink) {
+		std::vector<std::pair<std::string, bool>> tables;
+		if (!listTables(tables)) {
+			return false;
+		}
+		for (const auto & tableEntry : tables) {
+			if (!exportTable(sink, tableEntry.first, tableEntry.second)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Exporter::queryTableSize(const std::string &tableName, std::string &tableSizePretty, long long &tableSizeBytes) {
+		std::stringstream buildquery;
+		if (!lOptions.useSelectOnly) {
+			// Have to include sizes of child-tables in calculation!
+			buildquery << "SELECT "
+			           << " pg_size_pretty(pg_total_relation_size('" << tableName << "')), "
+			           << " pg_total_relation_size('" << tableName << "') "
+			           << " ;";
+			// Based on: http://dba.stackexchange.com/a/63935
+			buildquery << "SELECT "
+			           << " pg_size_pretty(COALESCE(sum(pg_total_relation_size(i.inhrelid::regclass))::bigint, 0) + pg_total_relation_size('" << tableName << "')), "
+			           << " COALESCE(sum(pg_total_relation_size(i.inhrelid::regclass))::bigint, 0) + pg_total_relation_size('" << tableName << "') "
+			           << " FROM   pg_inherits i "
+			           << " WHERE  i.inhparent = '" << tableName << "'::regclass"
+			           << " ;";
+		} else {
+			buildquery << "SELECT "
+			           << " pg_size_pretty(pg_total_relation_size('" << tableName << "')), "
+			           << " pg_total_relation_size('" << tableName << "') "
+			           << " ;";
+		}
+		PGresult* resBytes = PQexec(dbc, buildquery.str().c_str());
+		if (!((PQresultStatus(resBytes) == PGRES_TUPLES_OK) || (PQresultStatus(resBytes) == PGRES_COMMAND_OK))) {
+			PQclear(resBytes);
+			return fail(PQerrorMessage(dbc));
+		}
+
+		tableSizePretty = PQgetvalue(resBytes, 0, 0);
+		tableSizeBytes  = std::atoll(PQgetvalue(resBytes, 0, 1));
+		PQclear(resBytes);
+		return true;
+	}
+
+	bool Exporter::describeTable(const std::string &tableName, TableLayout &layout) {
+		std::set<int> &largeObjectColumns = layout.largeObjectColumns;
+		std::set<int> &timeZoneColumns = layout.timeZoneColumns;
+		std::set<int> &timeStampColumns = layout.timeStampColumns;
+		std::set<int> &integerColumns = layout.integerColumns;
+		std::set<int> &realColumns = layout.realColumns;
+		std::vector<std::string> &colNamesForPqSelect = layout.selectExpressions;
+
+		// The table as it will be created in SQLite.
+		TableDefinition &table = layout.table;
+		table.name = tableName;
+		table.strict = (lOptions.columnTypes == ColumnTypes::Strict);
+
+		// Columns of the view showing timestamps stored as numbers as text.
+		std::vector<std::string> readableColumns;
+		bool haveEpochColumns = false;
+
+		std::stringstream sqlite_create_query;
+
+		sqlite_create_query << "CREATE TABLE " << tableName << " (";
+
+		std::string sql_query = "";
+		std::stringstream buildquery;
+
+		// Select column names and datatypes:
+		{
+			buildquery.str("");
+			buildquery.clear();
+			// Besides the names from the information schema, get the type OID (of the base type for domains)
+			// and the full type name, used if the column types are mapped.
+			buildquery <<
+			           "select "
+			           "   c.column_name, "
+			           "   c.column_default, "
+			           "   c.data_type, "
+			           "   CASE WHEN t.typtype = 'd' THEN t.typbasetype ELSE t.oid END, "
+			           "   format_type(a.atttypid, a.atttypmod), "
+			           "   c.numeric_precision, "
+			           "   c.numeric_scale "
+			           " from "
+			           "   information_schema.columns c "
+			           "   join pg_attribute a on a.attrelid = '" << tableName << "'::regclass and a.attname = c.column_name "
+			           "   join pg_type t on t.oid = a.atttypid "
+			           " where"
+			           "   c.table_name='" << tableName << "'"
+			           " order by"
+			           "   c.ordinal_position;";
+			sql_query = buildquery.str();
+			PGresult* res2 = PQexec(dbc, sql_query.data());
+			if (!((PQresultStatus(res2) == PGRES_TUPLES_OK) || (PQresultStatus(res2) == PGRES_COMMAND_OK))) {
+				PQclear(res2);
+				return fail(PQerrorMessage(dbc));
+			}
+
+			if (PQresultStatus(res2) == PGRES_TUPLES_OK ) {
+				int rowCount = PQntuples(res2);
+				int colCount = PQnfields(res2);
+				if (colCount != 7) {
+					PQclear(res2);
+					return fail("Unexpected number of columns in (name,default,type,oid,format,precision,scale) query, something very wrong!!!");
+				}
+				for (int row = 0; row < rowCount; row++) { // These result-rows are the columns of the table!
+					// Echo column name here:
+					std::string colName = PQgetvalue(res2, row, 0);
+					sqlite_create_query << colName << " ";
+					table.columnNames.push_back(colName);
+
+					// Echo column default here:
+					std::string colDefault = PQgetvalue(res2, row, 1);
+					std::string pgDefault = colDefault;
+
+					// Echo column type here:
+					std::string colType = PQgetvalue(res2, row, 2);
+					if (colType.find("-") != std::string::npos) {
+						// PostgreSQL allows for strange characters in column types.
+						// Up to now, only "-" is known (as in USER-DEFINED).
+						// We just replace that with a space...
+						std::replace(colType.begin(), colType.end(), '-', ' ');
+					}
+
+					// Timestamps and dates stored as numbers since the epoch?
+					bool epochColumn = (lOptions.timestampStorage != TimestampStorage::Text) &&
+					                   ((colType == "timestamp with time zone") || (colType == "timestamp without time zone") || (colType == "date"));
+					bool epochMicroseconds = (lOptions.timestampStorage == TimestampStorage::EpochMicroseconds);
+
+					{
+						if ((colDefault.find("nextval(") != std::string::npos) && (colDefault.find("seq'::regclass)") != std::string::npos)) {
+							if (colType == "integer") {
+								// Looks like an autoincrement... create matching trigger!
+								std::string triggerQuery = "CREATE TRIGGER " + tableName + "_" + colName + "_autoincrement AFTER INSERT ON " + tableName + "";
+								triggerQuery += " FOR EACH ROW when new." + colName + " is NULL ";
+								triggerQuery += " BEGIN ";
+								triggerQuery += " UPDATE " + tableName + " SET " + colName + " = (SELECT IFNULL(MAX(" + colName + ")+1,0) FROM " + tableName + ") WHERE rowid = new.rowid;";
+								triggerQuery += " END; ";
+
+								table.triggerQueries.push_back(triggerQuery);
+							}
+							// Dirty hack: No default value then.
+							colDefault = "";
+						} else {
+							// Maybe this is a nice default we can also use?
+							if (colDefault == "now()") {
+								colDefault = "CURRENT_TIMESTAMP";
+							} else if (colDefault.find("'infinity'::timestamp") == 0) {
+								colDefault = "'9999-12-31 12:00:00'";
+							} else if (colDefault.find("'-infinity'::timestamp") == 0) {
+								colDefault = "'0000-00-00 12:00:00'";
+							} else if (colDefault.find("'Infinity'") != std::string::npos) {
+								colDefault = "9e999";
+							} else if (colDefault.find("'-Infinity'") != std::string::npos) {
+								colDefault = "-9e999";
+							} else if (colDefault.find("::") != std::string::npos) {
+								// Im feelin' lucky!
+								colDefault.erase(colDefault.find("::"), std::string::npos);
+							}
+						}
+					}
+					if (epochColumn && (colDefault.length() > 0)) {
+						bool literal = (colDefault[0] == '\'');
+						colDefault = epochDefault(colDefault, epochMicroseconds);
+						if (literal && colDefault.empty()) {
+							// Timestamps without time zone are in local time of the database server, see below.
+							std::string value = "(" + pgDefault + ")::" + colType;
+							if (colType == "timestamp without time zone") {
+								value = "(" + value + " at time zone '" + lOptions.pgTimezone + "')";
+							}
+							colDefault = evaluateEpochDefault(dbc, epochExpression(value, epochMicroseconds));
+						}
+					}
+
+					if (lOptions.columnTypes == ColumnTypes::PostgresNames) {
+						sqlite_create_query << colType;
+						layout.columnTypes.push_back(colType);
+					} else {
+						unsigned int typeOid = strtoul(PQgetvalue(res2, row, 3), nullptr, 10);
+						int numericPrecision = atoi(PQgetvalue(res2, row, 5));
+						int numericScale = atoi(PQgetvalue(res2, row, 6));
+						std::string sqliteType = epochColumn ? "INTEGER" : sqliteTypeForPgType(typeOid, numericPrecision, numericScale, lOptions.dumpLargeObjects);
+						if ((sqliteType == "TEXT") && (colDefault.length() > 0) && (colDefault[0] != '\'') && (typeOid == 1700)) {
+							// Numbers would be stored as REAL (or refused by STRICT tables), keep them as PostgreSQL prints them.
+							if (colDefault == "9e999") {
+								colDefault = "Infinity";
+							} else if (colDefault == "-9e999") {
+								colDefault = "-Infinity";
+							}
+							colDefault = "'" + colDefault + "'";
+						}
+						if (sqliteType == "INTEGER") {
+							integerColumns.insert(row);
+						} else if (sqliteType == "REAL") {
+							realColumns.insert(row);
+						}
+						if (typeOid == boolOid) {
+							// Stored as 0 / 1, like SQLite's own booleans.
+							colName += "::int";
+						}
+						sqlite_create_query << sqliteType;
+						layout.columnTypes.push_back(sqliteType);
+						table.columnTypes.push_back(sqliteType);
+						table.sourceTypes.push_back(PQgetvalue(res2, row, 4));
+					}
+
+					if (colDefault.length() > 0) {
+						sqlite_create_query << " default " << colDefault;
+					}
+
+					if ((colType == "boolean") || (colType == "inet") || (colType == "character")) {
+						// '::text' gives 'true', adds '/32' or strips the padding, unlike the values we fetch.
+						layout.outputTextColumns.insert(row);
+					}
+
+					if (colType == "oid") {
+						// Blobby stuff encountered!
+						largeObjectColumns.insert(row);
+					}
+
+					if (epochColumn) {
+						// Stored as number, no zone to cut off and no infinity strings.
+						std::string column = colName;
+						if (colType == "timestamp without time zone") {
+							// In local time of the database server, see below.
+							column = "(" + colName + " at time zone '" + lOptions.pgTimezone + "')";
+						}
+						colName = epochExpression(column, epochMicroseconds);
+						integerColumns.insert(row);
+						readableColumns.push_back(readableEpoch(table.columnNames.back(), colType == "date", epochMicroseconds) + " AS " + table.columnNames.back());
+						haveEpochColumns = true;
+					} else {
+						readableColumns.push_back(table.columnNames.back());
+					}
+
+					if (!epochColumn && (colType.find("with time zone") != std::string::npos)) {
+						// Column with time zone encountered, need to take special care (cut off the +00!)
+						timeZoneColumns.insert(row);
+					}
+
+					if (!epochColumn && (colType.find("timestamp") != std::string::npos)) {
+						// Column with time stamp encountered, need to take special care for infinity stuff
+						timeStampColumns.insert(row);
+					}
+
+					if (!epochColumn && (colType.find("without time zone") != std::string::npos)) {
+						// Column without time zone encountered, need to take special care.
+						// Postgres stores and displays these IN LOCAL TIME of the database server.
+						// We don't want this SQLite prefers UTC for string-matching.
+						colName += " at time zone '" + lOptions.pgTimezone + "'";
+
+						// Also for columns without time zone we will get '+00'
+						// when doing the typecast-select.
+						timeZoneColumns.insert(row);
+					}
+
+					colNamesForPqSelect.push_back(colName);
+
+					if (row != rowCount - 1) {
+						sqlite_create_query << ", ";
+					}
+				}
+			}
+			PQclear(res2);
+		}
+
+		sqlite_create_query << ");";
+		table.createQuery = sqlite_create_query.str();
+
+		if (haveEpochColumns) {
+			std::string viewQuery = "CREATE VIEW " + tableName + "_readable AS SELECT ";
+			for (size_t col = 0; col < readableColumns.size(); col++) {
+				viewQuery += ((col == 0) ? "" : ", ") + readableColumns[col];
+			}
+			viewQuery += " FROM " + tableName + ";";
+			table.viewQueries.push_back(viewQuery);
+		}
+		return true;
+	}
+
+	std::string Exporter::filterClause(const std::string &tableName) const {
+		auto it = lOptions.tableFilters.find(tableName);
+		if (it == lOptions.tableFilters.end()) {
+			return "";
+		}
+		return " WHERE (" + it->second + ")";
+	}
+
+	bool Exporter::listChildRelations(const std::string &tableName, std::vector<ChildRelation> &children) {
+		children.clear();
+
+		// The table itself and all tables inheriting from it, directly or not,
+		// as far as they can hold rows (partitioned tables can not).
+		std::stringstream buildquery;
+		buildquery << "WITH RECURSIVE tree(relid) AS ("
+		           << "  SELECT '" << tableName << "'::regclass::oid"
+		           << "  UNION"
+		           << "  SELECT i.inhrelid FROM pg_inherits i JOIN tree ON i.inhparent = tree.relid"
+		           << ")"
+		           << " SELECT c.oid::regclass::text, c.relname, pg_total_relation_size(c.oid)"
+		           << " FROM tree JOIN pg_class c ON c.oid = tree.relid"
+		           << " WHERE c.relkind IN ('r', 'f')"
+		           << " ORDER BY 3 DESC;";
+		std::string sql_query = buildquery.str();
+		PGresult* res = PQexec(dbc, sql_query.data());
+		if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+			PQclear(res);
+			return fail(PQerrorMessage(dbc));
+		}
+		for (int i = 0; i < PQntuples(res); i++) {
+			ChildRelation child;
+			child.name = PQgetvalue(res, i, 0);
+			child.relationName = PQgetvalue(res, i, 1);
+			child.sizeBytes = atoll(PQgetvalue(res, i, 2));
+			children.push_back(child);
+		}
+		PQclear(res);
+
+		std::string filter = filterClause(tableName);
+		if (filter.empty() || children.empty()) {
+			return true;
+		}
+
+		// Let the planner decide which children the filter leaves, they appear as relations in the plan.
+		buildquery.str("");
+		buildquery.clear();
+		buildquery << "EXPLAIN (FORMAT JSON) SELECT 1 FROM " << tableName << filter << ";";
+		sql_query = buildquery.str();
+		res = PQexec(dbc, sql_query.data());
+		if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+			PQclear(res);
+			return fail(PQerrorMessage(dbc));
+		}
+		std::set<std::string> scanned;
+		const std::string key = "\"Relation Name\": \"";
+		for (int i = 0; i < PQntuples(res); i++) {
+			std::string plan = PQgetvalue(res, i, 0);
+			for (size_t pos = plan.find(key); pos != std::string::npos; pos = plan.find(key, pos)) {
+				pos += key.length();
+				size_t end = plan.find('"', pos);
+				if (end == std::string::npos) {
+					break;
+				}
+				scanned.insert(plan.substr(pos, end - pos));
+			}
+		}
+		PQclear(res);
+
+		children.erase(std::remove_if(children.begin(), children.end(),
+		                              [&](const ChildRelation &child) { return scanned.count(child.relationName) == 0; }),
+		               children.end());
+		return true;
+	}
+
+	bool Exporter::exportChildScans(TableSink &sink, const TableLayout &layout, const std::vector<ChildRelation> &children,
+	                                unsigned connections, long long &rowCount) {
+		const std::string &tableName = layout.table.name;
+		ResourceBudget *budget = lOptions.budget;
+
+		// The scans see exactly what the transaction of the parent sees.
+		PGresult* res = PQexec(dbc, "SELECT pg_export_snapshot();");
+		if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+			PQclear(res);
+			return fail(PQerrorMessage(dbc));
+		}
+		std::string snapshot = PQgetvalue(res, 0, 0);
+		PQclear(res);
+
+		std::string selectList;
+		for (auto it = layout.selectExpressions.begin(); it != layout.selectExpressions.end(); ++it) {
+			if (it != layout.selectExpressions.begin()) {
+				selectList += ",";
+			}
+			selectList += *it;
+		}
+		std::string filter = filterClause(tableName);
+
+		// A fetched child, or the error of a connection if res is nullptr.
+		struct Scan {
+			PGresult *res = nullptr;
+			size_t memory = 0;
+			std::string error;
+		};
+		std::mutex lock;
+		std::condition_variable changed;
+		std::deque<Scan> fetched;
+		size_t nextChild = 0;
+		bool stop = false;
+
+		auto scanChildren = [&]() {
+			std::string error;
+			// Same settings as the main connection, which already warned about the receive buffer.
+			std::string warning;
+			PGconn *conn = openConnection(connectionParameters, lOptions.tcpReceiveBuffer, error, warning);
+			if (conn != nullptr) {
+				std::string begin = "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY; SET TRANSACTION SNAPSHOT '" + snapshot + "';";
+				PGresult* resBegin = PQexec(conn, begin.c_str());
+				if (PQresultStatus(resBegin) != PGRES_COMMAND_OK) {
+					error = PQerrorMessage(conn);
+				}
+				PQclear(resBegin);
+			}
+
+			while (error.empty()) {
+				size_t child;
+				{
+					// Do not run ahead of the writer by more than one result per connection.
+					std::unique_lock<std::mutex> guard(lock);
+					changed.wait(guard, [&] { return stop || fetched.size() < connections; });
+					if (stop || nextChild == children.size()) {
+						break;
+					}
+					child = nextChild++;
+				}
+
+				Scan scan;
+				if (budget != nullptr) {
+					scan.memory = budget->acquireMemory(children[child].sizeBytes);
+				}
+				std::string query = "SELECT " + selectList + " FROM ONLY " + children[child].name + filter + ";";
+				scan.res = PQexec(conn, query.c_str());
+				if (PQresultStatus(scan.res) != PGRES_TUPLES_OK) {
+					error = PQerrorMessage(conn);
+					PQclear(scan.res);
+					if (budget != nullptr) {
+						budget->releaseMemory(scan.memory);
+					}
+					break;
+				}
+				bool stopped;
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					stopped = stop;
+					if (!stopped) {
+						fetched.push_back(scan);
+					}
+				}
+				if (stopped) {
+					// Nobody will write it, and others might wait for its memory.
+					PQclear(scan.res);
+					if (budget != nullptr) {
+						budget->releaseMemory(scan.memory);
+					}
+					break;
+				}
+				changed.notify_all();
+			}
+
+			if (!error.empty()) {
+				Scan scan;
+				scan.error = error;
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					fetched.push_back(scan);
+				}
+				changed.notify_all();
+			}
+			// Nothing to commit, the transaction only read.
+			if (conn != nullptr) {
+				PQfinish(conn);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < connections; i++) {
+			workers.emplace_back(scanChildren);
+		}
+
+		// Write the children in the order they arrive, this thread is the only writer of the sink.
+		bool ok = true;
+		for (size_t written = 0; written < children.size(); written++) {
+			Scan scan;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return !fetched.empty(); });
+				scan = fetched.front();
+				fetched.pop_front();
+			}
+			changed.notify_all();
+
+			if (scan.res == nullptr) {
+				ok = fail(scan.error);
+				break;
+			}
+			long long childRows = PQntuples(scan.res);
+			ok = writeRows(sink, layout, scan.res, rowCount, rowCount + childRows);
+			rowCount += childRows;
+			PQclear(scan.res);
+			if (budget != nullptr) {
+				budget->releaseMemory(scan.memory);
+			}
+			if (!ok) {
+				break;
+			}
+		}
+
+		// Results not written after an error. Their memory has to be released before joining,
+		// workers waiting for it in acquireMemory() could not finish otherwise.
+		// Once stop is set, workers release what they fetch themselves.
+		std::deque<Scan> unwritten;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+			unwritten.swap(fetched);
+		}
+		changed.notify_all();
+		for (Scan &scan : unwritten) {
+			if (scan.res != nullptr) {
+				PQclear(scan.res);
+				if (budget != nullptr) {
+					budget->releaseMemory(scan.memory);
+				}
+			}
+		}
+		for (std::thread &worker : workers) {
+			worker.join();
+		}
+		return ok;
+	}
+
+	bool Exporter::writeRows(TableSink &sink, const TableLayout &layout, PGresult *res, long long rowsBefore, long long rowsTotal) {
+		const std::string &tableName = layout.table.name;
+		const std::set<int> &largeObjectColumns = layout.largeObjectColumns;
+		const std::set<int> &timeZoneColumns = layout.timeZoneColumns;
+		const std::set<int> &timeStampColumns = layout.timeStampColumns;
+		const std::set<int> &integerColumns = layout.integerColumns;
+		const std::set<int> &realColumns = layout.realColumns;
+
+		int rowCount = PQntuples(res);
+		int colCount = PQnfields(res);
+
+		// The converted row handed to the sink, and buffers or sources for large objects.
+		std::vector<FieldValue> row(colCount);
+		std::vector<std::vector<char>> lObjBuffers(colCount);
+		std::vector<LargeObjectSource> lObjSources(colCount);
+
+		for (int i = 0; i < rowCount; i++) {
+			for (int j = 0; j < colCount; j++) {
+				FieldValue &field = row[j];
+				field.source = nullptr;
+
+				// Is this a large object column?
+				if ((largeObjectColumns.count(j) != 0) && (PQgetisnull(res, i, j) == 1)) {
+					field.kind = FieldValue::Null;
+					field.data = nullptr;
+					field.size = 0;
+				} else if (largeObjectColumns.count(j) != 0) {
+					unsigned int oid = strtoul(PQgetvalue(res, i, j), nullptr, 10);
+					out() << "  => Retrieving large object oid " << oid << " ";
+					size_t lObjSize = getLargeObjectSize(oid);
+					if (lObjSize == static_cast<size_t>(-1)) {
+						return fail("ERROR determining size!");
+					} else {
+						out() << "(size: " << (lObjSize) << "B) ";
+					}
+
+					int lObjFD = lo_open(dbc, oid, INV_READ);
+					if (lObjFD < 0) {
+						return fail("Error opening large object with ID " + std::to_string(oid) + "!\n" + PQerrorMessage(dbc));
+					}
+
+					out() << " (row: " << i << "/" << rowCount << ")";
+					out() << "\r" << std::setw(80) << " " << "\r" << std::flush;
+					lMetrics.largeObjectBytes += lObjSize;
+
+					if (lObjSize > lOptions.largeObjectStreamThreshold) {
+						// The sink reads the object while writing the row, it is closed afterwards.
+						lObjSources[j].dbc = dbc;
+						lObjSources[j].fd = lObjFD;
+						field.kind = FieldValue::StreamedBlob;
+						field.data = nullptr;
+						field.size = lObjSize;
+						field.source = &lObjSources[j];
+						continue;
+					}
+
+					std::vector<char> &buf = lObjBuffers[j];
+					buf.resize(lObjSize);
+
+					// lo_read() takes an int, so read in chunks.
+					size_t readBytes = 0;
+					while (readBytes < lObjSize) {
+						int chunkBytes = lo_read(dbc, lObjFD, buf.data() + readBytes, std::min(blobChunkSize, lObjSize - readBytes));
+						if (chunkBytes <= 0) {
+							break;
+						}
+						readBytes += chunkBytes;
+					}
+					if (readBytes != lObjSize) {
+						err() << "Expected " << lObjSize << " bytes, got " << readBytes << "!" << std::endl;
+						err() << PQerrorMessage(dbc) << std::endl;
+					}
+
+					if (lo_close(dbc, lObjFD) != 0) {
+						return fail("Error closing file descriptor to large object with ID " + std::to_string(oid) + "!\n" + PQerrorMessage(dbc));
+					}
+
+					// Empty large objects are valid, they become empty blobs instead of NULL.
+					static const char emptyBlob = 0;
+					field.kind = FieldValue::Blob;
+					field.data = (lObjSize > 0) ? buf.data() : &emptyBlob;
+					field.size = lObjSize;
+
+				} else {
+					bool handledSpecially = false;
+
+					bool fieldIsNull = (PQgetisnull(res, i, j) == 1 ? true : false);
+
+					const char* plainValue = PQgetvalue(res, i, j);
+
+					// Is this a column with a timestamp with time zone?
+					if (timeZoneColumns.count(j) != 0) {
+						const char *tsWithZone = plainValue;
+						const char *zonePart = strrchr(tsWithZone, '+');
+						if (zonePart != nullptr) {
+							// Cut off the zone by length, the value itself stays untouched.
+							field.kind = FieldValue::Text;
+							field.data = tsWithZone;
+							field.size = zonePart - tsWithZone;
+							handledSpecially = true;
+						}
+					}
+
+					// Is this a timestamp-column that might be infinite, and has not yet been handled?
+					if ((!handledSpecially) && (timeStampColumns.count(j) != 0)) {
+						if (strcmp(plainValue, "infinity") == 0) {
+							// This strange value is our +infty date
+							setText(field, "9999-12-31 12:00:00");
+							handledSpecially = true;
+						} else if (strcmp(plainValue, "-infinity") == 0) {
+							// This strange value is our -infty date
+							setText(field, "0000-00-00 12:00:00");
+							handledSpecially = true;
+						}
+					}
+
+					if (!handledSpecially) {
+						// Check whether we have to convert '(-)infinity' to SQLite's understanding of Inf / -Inf.
+						// 9e999 will be stored as comparable Inf / -Inf value, but is not ok for dates,
+						// corresponding workaround see above.
+						if (strcmp(plainValue, "infinity") == 0) {
+							setText(field, "9e999");
+							handledSpecially = true;
+						} else if (strcmp(plainValue, "-infinity") == 0) {
+							setText(field, "-9e999");
+							handledSpecially = true;
+						}
+					}
+
+					// Finally, the normal case :-)
+					if (!handledSpecially) {
+						if (fieldIsNull) {
+							field.kind = FieldValue::Null;
+							field.data = nullptr;
+							field.size = 0;
+						} else {
+							if (integerColumns.count(j) != 0) {
+								field.kind = FieldValue::Integer;
+							} else if (realColumns.count(j) != 0) {
+								field.kind = FieldValue::Real;
+							} else {
+								field.kind = FieldValue::Text;
+							}
+							field.data = plainValue;
+							field.size = PQgetlength(res, i, j);
+						}
+					}
+				}
+			}
+			bool rowWritten = sink.writeRow(row);
+			for (auto & source : lObjSources) {
+				if (source.fd < 0) {
+					continue;
+				}
+				if ((lo_close(dbc, source.fd) != 0) && rowWritten) {
+					return fail(std::string("Error closing file descriptor to large object!\n") + PQerrorMessage(dbc));
+				}
+				source.fd = -1;
+			}
+			if (!rowWritten) {
+				return fail(sink.lastError());
+			}
+
+			if (i % 1000 == 0) {
+				// give some feedback on long waiting times
+				out() << "inserting row " << rowsBefore + i + 1 << "/" << rowsTotal << "\r" << std::flush;
+				if (lOptions.onProgress) {
+					lOptions.onProgress(tableName, rowsBefore + i + 1, rowsTotal);
+				}
+			}
+		}
+		return true;
+	}
+
+	bool Exporter::exportTable(TableSink &sink, const std::string &tableName, bool isChildTable) {
+		if (isChildTable) {
+			if (!lOptions.useSelectOnly) {
+				// Then we do not want child tables!
+				out() << "[" << tableName << "]"
+				      << std::setw(32 - tableName.length()) << " "
+				      << "Is child-table, not in SELECT ONLY mode, skipping!" << std::endl;
+				lMetrics.tablesSkipped++;
+				return true;
+			} else {
+				out() << "[" << tableName << "]"
+				      << std::setw(32 - tableName.length()) << " "
+				      << "Is a child-table!" << std::endl;
+			}
+		}
+
+		TableLayout layout;
+		if (!describeTable(tableName, layout)) {
+			return false;
+		}
+		TableDefinition &table = layout.table;
+		std::set<int> &largeObjectColumns = layout.largeObjectColumns;
+		std::vector<std::string> &colNamesForPqSelect = layout.selectExpressions;
+
+		std::string sql_query = "";
+		std::stringstream buildquery;
+
+		// Now, we can build the select-query for postgres
+		{
+			// We do each table in one transaction for PGSQL:
+			if (!beginPGSQLTransaction()) {
+				return false;
+			}
+
+			// Check how large the table is, so the user can see what he/she is up to!
+			std::string tableSizePretty;
+			long long tableSizeBytes = 0;
+			if (!queryTableSize(tableName, tableSizePretty, tableSizeBytes)) {
+				return false;
+			}
+
+			if (lOptions.useMaxDumpSize == true) {
+				if (tableSizeBytes > maxDumpSize) {
+					err() << "[" << tableName                << "]" << " Table size is " << tableSizeBytes << " bytes (= " << tableSizePretty << ")!!!" << std::endl;
+					err() << std::setw(tableName.length() + 2) << ""  << " This size exceeds 1 GiB," << std::endl;
+					err() << std::setw(tableName.length() + 2) << ""  << " refusing to dump this, skipping table!" << std::endl;
+					err() << std::setw(tableName.length() + 2) << ""  << " You can override this behaviour with the -B parameter." << std::endl;
+					lMetrics.tablesSkipped++;
+					// Still create the (empty) table.
+					if (sink.beginTable(table) == TableSink::Result::Error || !sink.endTable(TableStatistics())) {
+						return fail(sink.lastError());
+					}
+					return endPGSQLTransaction();
+				}
+			}
+
+			bool tableNamePrinted = false;
+
+			// Recreated indexes (name, columns, uniqueness), used to fill sqlite_stat1.
+			std::vector<std::string> indexNames;
+			std::vector<std::vector<std::string>> indexColumns;
+			std::vector<bool> indexIsUnique;
+
+			// Query columns which have indexes.
+			// See also: http://stackoverflow.com/questions/2204058/show-which-columns-an-index-is-on-in-postgresql
+			buildquery.str("");
+			buildquery.clear();
+			buildquery << " select "
+			           << "  i.relname as index_name,"
+			           << "  t.relname as table_name,"
+			           << "  array_to_string(array_agg(a.attname), ', ') as column_names,"
+			           << "  bool_and(ix.indisunique) as is_unique"
+			           << " from"
+			           << "  pg_class t,"
+			           << "  pg_class i,"
+			           << "  pg_index ix,"
+			           << "  pg_attribute a"
+			           << " where"
+			           << "  t.oid = ix.indrelid"
+			           << "  and i.oid = ix.indexrelid"
+			           << "  and a.attrelid = t.oid"
+			           << "  and a.attnum = ANY(ix.indkey)"
+			           << "  and t.relkind = 'r'"
+			           << "  and t.relname = '" << tableName << "'"
+			           << " group by "
+			           << "  t.relname,"
+			           << "  i.relname"
+			           << " order by"
+			           << "  t.relname,"
+			           << "  i.relname;";
+			sql_query = buildquery.str();
+			PGresult* resIndexes = PQexec(dbc, sql_query.data());
+			if (!((PQresultStatus(resIndexes) == PGRES_TUPLES_OK) || (PQresultStatus(resIndexes) == PGRES_COMMAND_OK))) {
+				PQclear(resIndexes);
+				return fail(PQerrorMessage(dbc));
+			}
+			int indexesCount = PQntuples(resIndexes);
+			for (int i = 0; i < indexesCount; i++) {
+				buildquery.str("");
+				buildquery.clear();
+				buildquery << "CREATE INDEX "
+				           << " '" << PQgetvalue(resIndexes, i, 0) << "'"
+				           << "  ON "
+				           << " '" << PQgetvalue(resIndexes, i, 1) << "'"
+				           << " (" << PQgetvalue(resIndexes, i, 2) << ");";
+				table.indexQueries.push_back(buildquery.str());
+
+				indexNames.push_back(PQgetvalue(resIndexes, i, 0));
+				indexColumns.push_back(std::vector<std::string>());
+				std::stringstream columnList(PQgetvalue(resIndexes, i, 2));
+				std::string indexColumn;
+				while (std::getline(columnList, indexColumn, ',')) {
+					indexColumn.erase(0, indexColumn.find_first_not_of(' '));
+					indexColumns.back().push_back(indexColumn);
+				}
+				indexIsUnique.push_back(strcmp(PQgetvalue(resIndexes, i, 3), "t") == 0);
+			}
+			PQclear(resIndexes);
+
+			// Distinct value estimates per column, used to fill sqlite_stat1.
+			// Prefer the statistics matching the way we SELECT (including / excluding children).
+			std::map<std::string, double> columnNDistinct;
+			if (lOptions.statsFromPostgres) {
+				buildquery.str("");
+				buildquery.clear();
+				buildquery << "SELECT DISTINCT ON (attname) "
+				           << "  attname, n_distinct"
+				           << " FROM pg_stats"
+				           << " WHERE"
+				           << "  schemaname NOT IN ('pg_catalog', 'information_schema')"
+				           << "  AND tablename = '" << tableName << "'"
+				           << " ORDER BY"
+				           << "  attname, (inherited = " << (lOptions.useSelectOnly ? "false" : "true") << ") DESC;";
+				sql_query = buildquery.str();
+				// A failing query aborts the transaction, the savepoint allows to go on without statistics.
+				PGresult* resSavepoint = PQexec(dbc, "SAVEPOINT pgtosqlite_stats;");
+				bool savepointOk = (PQresultStatus(resSavepoint) == PGRES_COMMAND_OK);
+				PQclear(resSavepoint);
+				if (!savepointOk) {
+					return fail(PQerrorMessage(dbc));
+				}
+				PGresult* resStats = PQexec(dbc, sql_query.data());
+				const char *endSavepoint = "RELEASE SAVEPOINT pgtosqlite_stats;";
+				if (PQresultStatus(resStats) == PGRES_TUPLES_OK) {
+					for (int i = 0; i < PQntuples(resStats); i++) {
+						if (PQgetisnull(resStats, i, 1) == 0) {
+							columnNDistinct[PQgetvalue(resStats, i, 0)] = atof(PQgetvalue(resStats, i, 1));
+						}
+					}
+				} else {
+					// Not fatal, we can still fall back to ANALYZE.
+					err() << PQerrorMessage(dbc) << std::endl;
+					endSavepoint = "ROLLBACK TO SAVEPOINT pgtosqlite_stats;";
+				}
+				PQclear(resStats);
+				resSavepoint = PQexec(dbc, endSavepoint);
+				savepointOk = (PQresultStatus(resSavepoint) == PGRES_COMMAND_OK);
+				PQclear(resSavepoint);
+				if (!savepointOk) {
+					return fail(PQerrorMessage(dbc));
+				}
+			}
+
+			// Create table, triggers and indexes.
+			TableSink::Result result = sink.beginTable(table);
+			if (result == TableSink::Result::Error) {
+				return fail(sink.lastError());
+			} else if (result == TableSink::Result::SkipTable) {
+				lMetrics.tablesSkipped++;
+				return endPGSQLTransaction();
+			}
+
+			if (lOptions.dumpLargeObjects != true) {
+				largeObjectColumns.clear();
+			}
+
+			// Children scanned on their own, with the additional connections to use.
+			std::vector<ChildRelation> children;
+			unsigned scanConnections = 0;
+			if (!lOptions.useSelectOnly && lOptions.childScanConnections > 0) {
+				if (!listChildRelations(tableName, children)) {
+					return false;
+				}
+				if (children.size() > 1) {
+					scanConnections = std::min<size_t>(lOptions.childScanConnections, children.size());
+					if (connectionBudget != nullptr) {
+						// Never wait for connections here, we already hold one and might block others holding theirs.
+						scanConnections = connectionBudget->tryAcquireConnections(budgetHost, scanConnections);
+					}
+				}
+			}
+
+			long long rowCount = 0;
+			if (scanConnections > 0) {
+				if (!tableNamePrinted) {
+					out() << "[" << tableName << "]"
+					      << std::setw(32 - tableName.length()) << " ";
+				} else {
+					out() << std::setw(34) << " ";
+				}
+				out() << std::setw(10) << tableSizePretty
+				      << " in "   << std::setw(3) << children.size() << " children"
+				      << " over " << scanConnections << " connections." << std::endl;
+
+				bool ok = exportChildScans(sink, layout, children, scanConnections, rowCount);
+				if (connectionBudget != nullptr) {
+					connectionBudget->releaseConnections(budgetHost, scanConnections);
+				}
+				if (!ok) {
+					return false;
+				}
+			} else {
+				buildquery.str("");
+				buildquery.clear();
+				buildquery << "SELECT ";
+				for (auto it = colNamesForPqSelect.begin(); it != colNamesForPqSelect.end(); ++it) {
+					buildquery << *it;
+					if ((it + 1) != colNamesForPqSelect.end()) {
+						buildquery << ",";
+					}
+				}
+				buildquery <<	" FROM ";
+				if (lOptions.useSelectOnly) {
+					buildquery << " ONLY ";
+				}
+				buildquery << "   " << tableName << filterClause(tableName) << ";";
+				sql_query = buildquery.str();
+
+				if (!tableNamePrinted) {
+					out() << "[" << tableName << "]"
+					      << std::setw(32 - tableName.length()) << " ";
+				} else {
+					out() << std::setw(34) << " ";
+				}
+				// The whole table is fetched at once, its size on disk is our estimate for the memory needed.
+				MemoryReservation memory(lOptions.budget, tableSizeBytes);
+
+				out() << "Fetching " << (lOptions.useSelectOnly ? "ONLY" : "FULL") << " table, size: " << std::setw(10) << tableSizePretty << "..." ;
+				out() << "\r" << std::flush;
+
+				PGresult* res3 = PQexec(dbc, sql_query.data());
+				if (!((PQresultStatus(res3) == PGRES_TUPLES_OK) || (PQresultStatus(res3) == PGRES_COMMAND_OK))) {
+					PQclear(res3);
+					return fail(PQerrorMessage(dbc));
+				}
+				// Clear the result on every way out.
+				std::unique_ptr<PGresult, void(*)(PGresult *)> res3Guard(res3, PQclear);
+
+				rowCount = PQntuples(res3);
+				int colCount = PQnfields(res3);
+				if (!tableNamePrinted) {
+					out() << "[" << tableName << "]"
+					      << std::setw(32 - tableName.length()) << " ";
+				} else {
+					out() << std::setw(34) << " ";
+				}
+				out() <<             std::setw(10) << tableSizePretty
+				      << " from " << std::setw( 7) << rowCount << " rows"
+				      << " in "   << std::setw( 3) << colCount << " columns";
+
+				if (!largeObjectColumns.empty()) {
+					out() << "." << std::endl;
+					out() << std::setw(32) << "" << "Table has large objects," << std::endl;
+					out() << std::setw(32) << "" << "consider fetching a coffee or two!" << std::endl;
+				} else {
+					out() << "." << std::endl;
+				}
+
+				out() << std::flush;
+
+				if (!writeRows(sink, layout, res3, 0, rowCount)) {
+					return false;
+				}
+			}
+
+			TableStatistics statistics;
+			if (lOptions.statsFromPostgres) {
+				statistics = buildTableStatistics(rowCount, indexNames, indexColumns, indexIsUnique, columnNDistinct);
+			}
+			if (!sink.endTable(statistics)) {
+				return fail(sink.lastError());
+			}
+
+			if (!endPGSQLTransaction()) {
+				return false;
+			}
+
+			lMetrics.tablesExported++;
+			lMetrics.rowsExported += rowCount;
+			if (lOptions.onTableDone) {
+				lOptions.onTableDone(tableName, rowCount);
+			}
+		}
+
+		return true;
+	}
+
+	std::string Exporter::buildVerifyQuery(const std::string &tableName, const TableLayout &layout) {
+		std::stringstream buildquery;
+		buildquery << "SELECT count(*), "
+		           << " ((COALESCE(sum(('x' || substr(md5(";
+		size_t colCount = layout.selectExpressions.size();
+		if (colCount == 0) {
+			buildquery << "decode('', 'hex')";
+		}
+		for (size_t j = 0; j < colCount; j++) {
+			const std::string &column = layout.selectExpressions[j];
+			if (j != 0) {
+				buildquery << " || ";
+			}
+			if (lOptions.dumpLargeObjects && (layout.largeObjectColumns.count(j) != 0)) {
+				buildquery << "(CASE WHEN " << column << " IS NULL THEN decode('00', 'hex')"
+				           << " ELSE decode('02', 'hex') || decode(md5(lo_get(" << column << ")), 'hex') END)";
+			} else {
+				std::string value = "(" + column + ")::text";
+				if (layout.outputTextColumns.count(j) != 0) {
+					// format() uses the output function of the type, as libpq does when exporting.
+					value = "(CASE WHEN (" + column + ") IS NULL THEN NULL ELSE format('%s', " + column + ") END)";
+				}
+				if (layout.realColumns.count(j) != 0) {
+					// Inserted as doubles, where NaN becomes NULL.
+					value = "(CASE (" + column + ")::float8 WHEN 'NaN' THEN NULL"
+					        " WHEN 'Infinity' THEN '9e999' WHEN '-Infinity' THEN '-9e999' ELSE " + value + " END)";
+				}
+				buildquery << "pg_temp.pgtosqlite_field(" << value << ", "
+				           << ((layout.timeZoneColumns.count(j) != 0) ? "true" : "false") << ", "
+				           << ((layout.timeStampColumns.count(j) != 0) ? "true" : "false") << ", "
+				           << (hasNumericAffinity(layout.columnTypes[j]) ? "true" : "false") << ")";
+			}
+		}
+		// The sum of the row hashes as unsigned 64 bit integer.
+		buildquery << "), 1, 16))::bit(64)::bigint), 0) % 18446744073709551616) + 18446744073709551616) % 18446744073709551616"
+		           << " FROM ";
+		if (lOptions.useSelectOnly) {
+			buildquery << " ONLY ";
+		}
+		buildquery << "   " << tableName << filterClause(tableName) << ";";
+		return buildquery.str();
+	}
+
+	bool Exporter::verify(const std::string &sqliteFilename, unsigned threads) {
+		lLastError.clear();
+		lVerification.clear();
+		if (threads == 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		if (!connect()) {
+			return false;
+		}
+
+		bool success = verifyTables(sqliteFilename, threads);
+
+		if (haveVerifyFun) {
+			PGresult* res = PQexec(dbc, "DROP FUNCTION IF EXISTS pg_temp.pgtosqlite_field(text, boolean, boolean, boolean);");
+			if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+				success = fail(PQerrorMessage(dbc));
+			}
+			PQclear(res);
+			haveVerifyFun = false;
+		}
+		return success;
+	}
+
+	bool Exporter::verifyTables(const std::string &sqliteFilename, unsigned threads) {
+		if (!haveVerifyFun) {
+			// Encodes a value as it ends up in SQLite, after the conversions done by exportTable(), see verifier.h.
+			std::stringstream buildquery;
+			buildquery << "CREATE OR REPLACE FUNCTION pg_temp.pgtosqlite_field(value text, cut_zone boolean, is_timestamp boolean, is_numeric boolean) RETURNS bytea AS $fun$ "
+			           << "SELECT CASE "
+			           << "    WHEN t IS NULL THEN decode('00', 'hex') "
+			           << "    WHEN is_numeric AND t = '9e999' THEN decode('01', 'hex') || float8send('Infinity'::float8) "
+			           << "    WHEN is_numeric AND t = '-9e999' THEN decode('01', 'hex') || float8send('-Infinity'::float8) "
+			           << "    WHEN is_numeric AND t ~ '^[+-]?([0-9]+(\\.[0-9]*)?|\\.[0-9]+)([eE][+-]?[0-9]+)?$' "
+			           << "        THEN decode('01', 'hex') || float8send(t::float8 + 0::float8) "
+			           << "    ELSE decode('03', 'hex') || int4send(octet_length(convert_to(t, pg_client_encoding()))) || convert_to(t, pg_client_encoding()) "
+			           << "  END "
+			           << "  FROM (SELECT CASE "
+			           << "    WHEN cut_zone AND strpos(value, '+') > 0 THEN regexp_replace(value, '\\+[^+]*$', '') "
+			           << "    WHEN is_timestamp AND value = 'infinity' THEN '9999-12-31 12:00:00' "
+			           << "    WHEN is_timestamp AND value = '-infinity' THEN '0000-00-00 12:00:00' "
+			           << "    WHEN value = 'infinity' THEN '9e999' "
+			           << "    WHEN value = '-infinity' THEN '-9e999' "
+			           << "    ELSE value END AS t) AS converted "
+			           << "$fun$ LANGUAGE sql STABLE;";
+			PGresult* res = PQexec(dbc, buildquery.str().c_str());
+			if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+				PQclear(res);
+				return fail(PQerrorMessage(dbc));
+			}
+			PQclear(res);
+			haveVerifyFun = true;
+		}
+
+		std::vector<std::pair<std::string, bool>> tables;
+		if (!listTables(tables)) {
+			return false;
+		}
+
+		unsigned mismatches = 0;
+		for (const auto & tableEntry : tables) {
+			const std::string &tableName = tableEntry.first;
+			if (tableEntry.second && !lOptions.useSelectOnly) {
+				// Accounted to the parent table.
+				continue;
+			}
+
+			TableLayout layout;
+			if (!describeTable(tableName, layout)) {
+				return false;
+			}
+			std::string tableSizePretty;
+			long long tableSizeBytes = 0;
+			if (!queryTableSize(tableName, tableSizePretty, tableSizeBytes)) {
+				return false;
+			}
+			if (lOptions.useMaxDumpSize && (tableSizeBytes > maxDumpSize)) {
+				out() << "[" << tableName << "]"
+				      << std::setw(32 - tableName.length()) << " "
+				      << "Not dumped as larger than 1 GiB, skipping!" << std::endl;
+				continue;
+			}
+
+			out() << "[" << tableName << "]"
+			      << std::setw(32 - tableName.length()) << " "
+			      << "Verifying, size: " << std::setw(10) << tableSizePretty << "..." << "\r" << std::flush;
+
+			// SQLite is scanned while PostgreSQL computes its hash.
+			TableVerification result;
+			result.tableName = tableName;
+			bool sqliteOk = false;
+			std::string sqliteError;
+			std::thread sqliteScan([&] {
+				sqliteOk = hashSqliteTable(sqliteFilename, tableName, threads, result.sqliteRows, result.sqliteHash, sqliteError);
+			});
+			PGresult* res = PQexec(dbc, buildVerifyQuery(tableName, layout).c_str());
+			sqliteScan.join();
+
+			if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+				PQclear(res);
+				return fail(PQerrorMessage(dbc));
+			}
+			result.pgRows = atoll(PQgetvalue(res, 0, 0));
+			result.pgHash = strtoull(PQgetvalue(res, 0, 1), nullptr, 10);
+			PQclear(res);
+			if (!sqliteOk) {
+				return fail(sqliteError);
+			}
+
+			out() << "[" << tableName << "]"
+			      << std::setw(32 - tableName.length()) << " "
+			      << std::setw(10) << result.pgRows << " rows";
+			if (result.matches()) {
+				out() << ", OK." << std::endl;
+			} else {
+				mismatches++;
+				out() << ", MISMATCH!" << std::endl;
+				err() << std::setw(34) << "" << "PostgreSQL: " << result.pgRows << " rows, hash " << std::hex << result.pgHash << std::dec << std::endl;
+				err() << std::setw(34) << "" << "SQLite:     " << result.sqliteRows << " rows, hash " << std::hex << result.sqliteHash << std::dec << std::endl;
+			}
+			lVerification.push_back(result);
+		}
+
+		if (mismatches != 0) {
+			return fail(std::to_string(mismatches) + " of " + std::to_string(lVerification.size()) + " tables differ between PostgreSQL and SQLite!");
+		}
+		out() << "All " << lVerification.size() << " tables match." << std::endl;
+		return true;
+	}
+
+} // namespace pgToSqlite
@@ -0,0 +1,269 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_EXPORTER_H
+#define PGTOSQLITE_EXPORTER_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <libpq-fe.h>
+
+#include "tableSink.h"
+
+namespace pgToSqlite {
+
+	class ResourceBudget;
+
+	// How the columns of a table are declared in SQLite.
+	enum class ColumnTypes {
+		// The PostgreSQL type names, from which SQLite derives an affinity.
+		PostgresNames,
+		// INTEGER, REAL, TEXT or BLOB chosen by PostgreSQL type, with numbers inserted as such.
+		// numeric is INTEGER only without scale and up to 18 digits, otherwise TEXT, so no digits are lost.
+		// real / double precision become REAL, where NaN is stored as NULL.
+		// The original types are kept in the table pgtosqlite_column_types.
+		Mapped,
+		// Like Mapped, with STRICT tables where SQLite supports them (3.37.0 and newer).
+		Strict
+	};
+
+	// How timestamps and dates are stored in SQLite.
+	enum class TimestampStorage {
+		// As text in UTC without zone, infinite timestamps as '9999-12-31 12:00:00' / '0000-00-00 12:00:00'
+		// and infinite dates as 9e999 / -9e999 (Inf / -Inf).
+		Text,
+		// As integer seconds / microseconds since 1970-01-01 UTC, infinities as the largest / smallest 64 bit integer.
+		// A view <table>_readable shows these columns as they would have been stored as text.
+		EpochSeconds,
+		EpochMicroseconds
+	};
+
+	// Settings for an export. The defaults match those of the command-line tool.
+	struct ExportOptions {
+		std::string dbHost = "localhost";
+		unsigned dbPort = 5432;
+		std::string dbName;
+		std::string dbUser;
+		std::string dbPassword;
+		// Full libpq connection string or URI (e.g. for service files or several hosts), used instead of the settings
+		// above. dbName, if set, still overrides the database.
+		std::string dbConnInfo;
+		// Connect through the Unix-domain socket in this directory (with dbPort) instead of resolving dbHost.
+		std::string dbSocketDir;
+		// For TCP connections: seconds of idleness before keepalive probes are sent (0 = system default),
+		// and size of the socket receive buffer in bytes (0 = system default). A fixed size turns off the
+		// kernel's autotuning of the receive window, so a value below what autotuning reaches slows transfers down.
+		unsigned keepaliveIdle = 0;
+		size_t tcpReceiveBuffer = 0;
+
+		// Local time zone of the PostgreSQL server, needed to convert 'timestamp without time zone' columns.
+		std::string pgTimezone = "Europe/Berlin";
+
+		// Tables to exclude, interpreted with 'NOT LIKE' so SQL-patterns are allowed.
+		std::vector<std::string> excludeTables;
+
+		bool dumpLargeObjects = true;
+		// Large objects above this size in bytes are streamed into the sink in chunks instead of being read into memory.
+		size_t largeObjectStreamThreshold = 16 * 1024 * 1024;
+		// Exclude tables larger 1 GiB.
+		bool useMaxDumpSize = true;
+		// Use 'SELECT ONLY' and include child tables, instead of accounting children to their parent.
+		bool useSelectOnly = false;
+		// Scan the children (or partitions) of a table over up to this many additional connections sharing one snapshot,
+		// merging them into the table of their parent (0 = a single 'SELECT' on the parent). Not used with useSelectOnly.
+		unsigned childScanConnections = 0;
+		// Row filters per table as SQL conditions. Children and partitions excluded by them are not scanned.
+		std::map<std::string, std::string> tableFilters;
+
+		ColumnTypes columnTypes = ColumnTypes::PostgresNames;
+		TimestampStorage timestampStorage = TimestampStorage::Text;
+
+		// Fill sqlite_stat1 from pg_stats instead of running a full 'ANALYZE;'.
+		bool statsFromPostgres = false;
+		// 'PRAGMA analysis_limit' for tables without PostgreSQL statistics (0 = unlimited).
+		unsigned analysisLimit = 1000;
+
+		// Collect sequential writes to the SQLite database in a buffer of this many bytes (0 = write pages directly).
+		size_t writeBufferSize = 0;
+		// Skip syncs of the SQLite database until it is closed. Only safe as nobody uses it before it is complete.
+		bool bulkLoad = false;
+
+		// Limits shared with concurrent exports: connections per host, and memory for fetched tables.
+		ResourceBudget *budget = nullptr;
+
+		// Where progress and error messages go. Set to separate streams when running exports concurrently.
+		std::ostream *out = &std::cout;
+		std::ostream *err = &std::cerr;
+
+		// Called regularly while inserting rows into a table.
+		std::function<void(const std::string &tableName, long long rowsDone, long long rowsTotal)> onProgress;
+		// Called once a table has been fully written.
+		std::function<void(const std::string &tableName, long long rows)> onTableDone;
+	};
+
+	// Summary of the last export.
+	struct ExportMetrics {
+		unsigned tablesExported = 0;
+		unsigned tablesSkipped = 0;
+		long long rowsExported = 0;
+		long long largeObjectBytes = 0;
+		double seconds = 0;
+	};
+
+	// Row count and content hash of a table in PostgreSQL and SQLite, see verifier.h.
+	struct TableVerification {
+		std::string tableName;
+		long long pgRows = 0;
+		long long sqliteRows = 0;
+		uint64_t pgHash = 0;
+		uint64_t sqliteHash = 0;
+
+		bool matches() const {
+			return (pgRows == sqliteRows) && (pgHash == sqliteHash);
+		}
+	};
+
+	// Dumps a PostgreSQL database into new SQLite files.
+	// The PostgreSQL connection is opened lazily and kept open between exports,
+	// so a single Exporter can serve many jobs. Separate instances may be used from separate threads.
+	class Exporter {
+	  public:
+		explicit Exporter(const ExportOptions &options);
+		~Exporter();
+
+		Exporter(const Exporter &) = delete;
+		Exporter &operator=(const Exporter &) = delete;
+
+		// Options may be changed between exports. Connection settings take effect on the next connect().
+		ExportOptions &options() {
+			return lOptions;
+		}
+
+		// Connects to PostgreSQL unless already connected, or reconnects a broken connection.
+		bool connect();
+		void disconnect();
+
+		// Dumps the database into sqliteFilename, which must not exist yet.
+		// Returns false on errors, with the reason available from lastError().
+		bool exportTo(const std::string &sqliteFilename);
+		// Like exportTo(), but stores everything in a capture file which can be replayed later.
+		bool captureTo(const std::string &captureFilename);
+		// Feeds the database into an arbitrary sink.
+		bool exportInto(TableSink &sink);
+
+		// Compares all tables which would be dumped with their copies in sqliteFilename, by row counts and
+		// content hashes. Each SQLite table is scanned by up to threads read-only connections (0 = one per CPU),
+		// while PostgreSQL computes its side. Returns false on errors or differences.
+		bool verify(const std::string &sqliteFilename, unsigned threads);
+		const std::vector<TableVerification> &verification() const {
+			return lVerification;
+		}
+
+		const std::string &lastError() const {
+			return lLastError;
+		}
+		const ExportMetrics &metrics() const {
+			return lMetrics;
+		}
+
+	  private:
+		// How the columns of a table are selected from PostgreSQL and converted for SQLite.
+		struct TableLayout {
+			TableDefinition table;
+			// Declared types of the columns in SQLite.
+			std::vector<std::string> columnTypes;
+			// Expressions used to select the columns, which can contain conversions, e.g. for timestamps without time zone.
+			std::vector<std::string> selectExpressions;
+			// Columns that contain large objects, timestamps with time zone and timestamps which might be infinite.
+			std::set<int> largeObjectColumns;
+			std::set<int> timeZoneColumns;
+			std::set<int> timeStampColumns;
+			// Columns inserted as integers or floating point numbers, if the column types are mapped.
+			std::set<int> integerColumns;
+			std::set<int> realColumns;
+			// Columns whose cast to text differs from the output libpq returns (boolean, inet, character).
+			std::set<int> outputTextColumns;
+		};
+
+		// A table holding rows of a parent, scanned on its own.
+		struct ChildRelation {
+			// Qualified as needed for queries.
+			std::string name;
+			std::string relationName;
+			long long sizeBytes = 0;
+		};
+
+		// Names of the tables to dump and whether they are child tables.
+		bool listTables(std::vector<std::pair<std::string, bool>> &tables);
+		bool exportTables(TableSink &sink);
+		bool exportTable(TableSink &sink, const std::string &tableName, bool isChildTable);
+		// Children and partitions of a table holding rows, largest first, without those pruned by its filter.
+		bool listChildRelations(const std::string &tableName, std::vector<ChildRelation> &children);
+		// Fetches the children over parallel connections and writes them into the table of their parent.
+		// Must be called within the transaction of the parent, whose snapshot the connections share.
+		bool exportChildScans(TableSink &sink, const TableLayout &layout, const std::vector<ChildRelation> &children,
+		                      unsigned connections, long long &rowCount);
+		// ' WHERE ...' for tables with a filter, otherwise empty.
+		std::string filterClause(const std::string &tableName) const;
+		// Converts the rows of a result and writes them into the sink, counting from rowsBefore for progress reports.
+		bool writeRows(TableSink &sink, const TableLayout &layout, PGresult *res, long long rowsBefore, long long rowsTotal);
+		// Reads the columns of a table and builds its SQLite definition.
+		bool describeTable(const std::string &tableName, TableLayout &layout);
+		// Size including indexes (and children, unless in 'SELECT ONLY' mode).
+		bool queryTableSize(const std::string &tableName, std::string &tableSizePretty, long long &tableSizeBytes);
+		// Query computing row count and content hash of a table in PostgreSQL.
+		std::string buildVerifyQuery(const std::string &tableName, const TableLayout &layout);
+		bool verifyTables(const std::string &sqliteFilename, unsigned threads);
+
+		bool beginPGSQLTransaction();
+		bool endPGSQLTransaction();
+		// Returns static_cast<size_t>(-1) on errors, empty large objects have size 0.
+		size_t getLargeObjectSize(unsigned int oid);
+		bool dropLOsizeFun();
+
+		// Reports an error, remembers it for lastError() and returns false.
+		bool fail(const std::string &message);
+
+		std::ostream &out() {
+			return *lOptions.out;
+		}
+		std::ostream &err() {
+			return *lOptions.err;
+		}
+
+		ExportOptions lOptions;
+		ExportMetrics lMetrics;
+		std::vector<TableVerification> lVerification;
+		std::string lLastError;
+
+		PGconn *dbc = nullptr;
+		// Settings of dbc as libpq keywords and values, also used for the connections of parallel scans.
+		std::vector<std::pair<std::string, std::string>> connectionParameters;
+		// Budget and host the connection was taken from, if any.
+		ResourceBudget *connectionBudget = nullptr;
+		std::string budgetHost;
+		bool haveLOsizeFun = false;
+		bool haveVerifyFun = false;
+	};
+
+} // namespace pgToSqlite
+
+#endif
@@ -0,0 +1,463 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sqliteWriter.h"
+#include "coalescingVfs.h"
+
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <sstream>
+#include <stdlib.h>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace pgToSqlite {
+
+	SqliteWriter::SqliteWriter(const std::string &sqliteFilename, const ExportOptions &options) :
+		lFilename(sqliteFilename),
+		lOptions(options) {
+	}
+
+	SqliteWriter::~SqliteWriter() {
+		if (sqliteDB != nullptr) {
+			finish(false);
+		}
+	}
+
+	void SqliteWriter::beginTransaction() {
+		char *sqlErrorMsg;
+		sqlite3_exec(sqliteDB, "BEGIN TRANSACTION;", nullptr, nullptr, &sqlErrorMsg);
+		if (sqlErrorMsg != nullptr) {
+			err() << std::setw(10) << "" << "Error starting SQLite3-transaction!" << std::endl;
+			err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+			err() << std::setw(10) << "" << "Continuing without..." << std::endl;
+		}
+		sqlite3_free(sqlErrorMsg);
+		rowsInTransaction = 0;
+	}
+
+	void SqliteWriter::endTransaction() {
+		char *sqlErrorMsg;
+		sqlite3_exec(sqliteDB, "END TRANSACTION;", nullptr, nullptr, &sqlErrorMsg);
+		if (sqlErrorMsg != nullptr) {
+			err() << std::setw(10) << "" << "Error ending SQLite3-transaction!" << std::endl;
+			err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+			err() << std::setw(10) << "" << "Trying to continue..." << std::endl;
+		}
+		sqlite3_free(sqlErrorMsg);
+	}
+
+	bool SqliteWriter::open() {
+		{
+			struct stat buffer;
+			if (stat(lFilename.c_str(), &buffer) == 0) {
+				lLastError = "File " + lFilename + " already exists! Will not delete it and stop here.";
+				return false;
+			}
+		}
+		// Buffered writes and skipped syncs need our own VFS.
+		const char *vfsName = nullptr;
+		if ((lOptions.writeBufferSize > 0) || lOptions.bulkLoad) {
+			vfsName = coalescingVfsName(lOptions.writeBufferSize, lOptions.bulkLoad);
+			if (vfsName == nullptr) {
+				err() << std::setw(10) << "" << "Error registering SQLite3-VFS for buffered writes!" << std::endl;
+				err() << std::setw(10) << "" << "Continuing without..." << std::endl;
+			}
+		}
+
+		// Create sqlite-DB:
+		int sql_ret = sqlite3_open_v2(lFilename.c_str(), &sqliteDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfsName);
+		if (sql_ret) {
+			lLastError = "FATAL: Can't open database: " + lFilename + " Error: " + sqlite3_errmsg(sqliteDB);
+			sqlite3_close(sqliteDB);
+			sqliteDB = nullptr;
+			return false;
+		}
+
+		// Before the big insertion begins, disable autocommit, or it will break your disk ;-)
+		beginTransaction();
+
+		// Statistics derived from PostgreSQL are written directly to sqlite_stat1.
+		// Tables for which this is not possible are collected to be analyzed at the end.
+		tablesToAnalyze.clear();
+		if (lOptions.statsFromPostgres) {
+			// Analyzing only the schema table is cheap and creates sqlite_stat1 for us.
+			char *sqlErrorMsg;
+			sqlite3_exec(sqliteDB, "ANALYZE sqlite_master;", nullptr, nullptr, &sqlErrorMsg);
+			if (sqlErrorMsg == nullptr) {
+				sqlite3_prepare_v2(sqliteDB, "INSERT INTO sqlite_stat1 (tbl, idx, stat) VALUES (?, ?, ?);", -1, &statInsertStmt, nullptr);
+			}
+			if (statInsertStmt == nullptr) {
+				err() << std::setw(10) << "" << "Error creating sqlite_stat1!" << std::endl;
+				if (sqlErrorMsg != nullptr) {
+					err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+				}
+				err() << std::setw(10) << "" << "Falling back to 'ANALYZE;' at the end..." << std::endl;
+			}
+			sqlite3_free(sqlErrorMsg);
+		}
+		return true;
+	}
+
+	TableSink::Result SqliteWriter::beginTable(const TableDefinition &table) {
+		lTableName = table.name;
+		lColumnNames = table.columnNames;
+		const std::string &tableName = table.name;
+
+		{
+			std::string createQuery = table.createQuery;
+			if (table.strict) {
+				if (sqlite3_libversion_number() >= 3037000) {
+					createQuery.insert(createQuery.rfind(')') + 1, " STRICT");
+				} else if (!strictUnsupportedReported) {
+					err() << std::setw(10) << "" << "SQLite " << sqlite3_libversion() << " does not support STRICT tables," << std::endl;
+					err() << std::setw(10) << "" << "creating normal ones..." << std::endl;
+					strictUnsupportedReported = true;
+				}
+			}
+
+			// now, we can create the corresponding table in SQLite:
+			char *sqlErrorMsg;
+			sqlite3_exec(sqliteDB, createQuery.c_str(), nullptr, nullptr, &sqlErrorMsg);
+			if (sqlErrorMsg != nullptr) {
+				err() << std::setw(10) << "" << "Error creating table '" << tableName << "'!" << std::endl;
+				err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+				err() << std::setw(10) << "" << "Query: " << createQuery << std::endl;
+				err() << std::setw(10) << "" << "Ignoring..." << std::endl;
+			}
+			sqlite3_free(sqlErrorMsg);
+		}
+
+		if (!table.sourceTypes.empty() && !writeColumnTypes(table)) {
+			return Result::Error;
+		}
+
+		for (auto & sqlQuery : table.viewQueries) {
+			char *sqlErrorMsg;
+			sqlite3_exec(sqliteDB, sqlQuery.c_str(), nullptr, nullptr, &sqlErrorMsg);
+			if (sqlErrorMsg != nullptr) {
+				err() << std::setw(10) << "" << "Error creating view!" << std::endl;
+				err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+				err() << std::setw(10) << "" << "Query: " << sqlQuery << std::endl;
+				err() << std::setw(10) << "" << "Ignoring..." << std::endl;
+			}
+			sqlite3_free(sqlErrorMsg);
+		}
+
+		{
+			// now, we can create the needed triggers in SQLite:
+			if (table.triggerQueries.size() > 0) {
+				out() << "[" << tableName << "]"
+				      << std::setw(32 - tableName.length()) << " "
+				      << std::setw(7) << table.triggerQueries.size() << " autoincrements, recreating...";
+
+				for (auto & sqlQuery : table.triggerQueries) {
+
+					char *sqlErrorMsg;
+					sqlite3_exec(sqliteDB, sqlQuery.c_str(), nullptr, nullptr, &sqlErrorMsg);
+					if (sqlErrorMsg != nullptr) {
+						err() << std::setw(10) << "" << "Error creating trigger!" << std::endl;
+						err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+						err() << std::setw(10) << "" << "Query: " << sqlQuery << std::endl;
+						err() << std::setw(10) << "" << "Ignoring..." << std::endl;
+					}
+					sqlite3_free(sqlErrorMsg);
+					out() << "." << std::flush;
+				}
+				out() << "done!" << std::endl;
+			}
+		}
+
+		std::stringstream sqlite_insert_query;
+		sqlite_insert_query << "INSERT INTO " << tableName << " VALUES (";
+		for (size_t col = 0; col < table.columnNames.size(); col++) {
+			sqlite_insert_query << ((col == 0) ? "?" : ", ?");
+		}
+		sqlite_insert_query << ");";
+		std::string sql_query = sqlite_insert_query.str();
+		int ret = sqlite3_prepare_v2(sqliteDB, sql_query.c_str(), -1, &insertStmt, nullptr);
+		if (ret != SQLITE_OK) {
+			err() << std::setw(10) << "" << "Error preparing insert-query, error " << ret << " " << sqlite3_errmsg(sqliteDB) << "!" << std::endl;
+			err() << std::setw(10) << "" << "Query was: " << std::endl;
+			err() << std::setw(10) << "" << sql_query << std::endl;
+			err() << std::setw(10) << "" << "As this might be a caused by something fancy" << std::endl;
+			err() << std::setw(10) << "" << "you may not need, we just skip it!" << std::endl;
+			sqlite3_finalize(insertStmt);
+			insertStmt = nullptr;
+			return Result::SkipTable;
+		}
+
+		if (table.indexQueries.size() > 0) {
+			out() << "[" << tableName << "]"
+			      << std::setw(32 - tableName.length()) << " "
+			      << std::setw(7) << table.indexQueries.size() << " indexes, recreating...";
+			for (auto & sqlQuery : table.indexQueries) {
+				char *sqlErrorMsg;
+				sqlite3_exec(sqliteDB, sqlQuery.c_str(), nullptr, nullptr, &sqlErrorMsg);
+				if (sqlErrorMsg != nullptr) {
+					err() << std::setw(10) << "" << "Error creating table '" << tableName << "'!" << std::endl;
+					err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+					err() << std::setw(10) << "" << "Query: " << sqlQuery << std::endl;
+					err() << std::setw(10) << "" << "Ignoring..." << std::endl;
+				}
+				sqlite3_free(sqlErrorMsg);
+				out() << "." << std::flush;
+			}
+			out() << "done!" << std::endl;
+		}
+
+		return Result::Ok;
+	}
+
+	bool SqliteWriter::writeRow(const std::vector<FieldValue> &row) {
+		bool haveStreamedBlobs = false;
+		for (size_t j = 0; j < row.size(); j++) {
+			int ret2 = 0;
+			const FieldValue &field = row[j];
+			switch (field.kind) {
+				case FieldValue::Null:
+					ret2 = sqlite3_bind_null(insertStmt, j + 1);
+					break;
+				case FieldValue::Text:
+					ret2 = sqlite3_bind_text(insertStmt, j + 1, field.data, field.size, SQLITE_STATIC);
+					break;
+				case FieldValue::Blob:
+					ret2 = sqlite3_bind_blob64(insertStmt, j + 1, field.data, field.size, SQLITE_STATIC);
+					break;
+				case FieldValue::Integer: {
+					// Anything else than a 64 bit integer (e.g. numeric NaN) is kept as text instead of becoming 0.
+					std::string text(field.data, field.size);
+					char *end = nullptr;
+					errno = 0;
+					long long value = strtoll(text.c_str(), &end, 10);
+					if (text.empty() || (*end != '\0') || (errno == ERANGE)) {
+						ret2 = sqlite3_bind_text(insertStmt, j + 1, field.data, field.size, SQLITE_STATIC);
+					} else {
+						ret2 = sqlite3_bind_int64(insertStmt, j + 1, value);
+					}
+					break;
+				}
+				case FieldValue::Real:
+					// NaN is bound as NULL by SQLite.
+					ret2 = sqlite3_bind_double(insertStmt, j + 1, strtod(std::string(field.data, field.size).c_str(), nullptr));
+					break;
+				case FieldValue::StreamedBlob:
+					// Reserve the space now, the content is copied in after the insert.
+					ret2 = sqlite3_bind_zeroblob64(insertStmt, j + 1, field.size);
+					haveStreamedBlobs = true;
+					break;
+			}
+			if (ret2 != SQLITE_OK) {
+				lLastError = "Error binding values to insert-query, error code " + std::to_string(ret2) + "!\n" + sqlite3_errmsg(sqliteDB);
+				return false;
+			}
+		}
+		int ret3 = sqlite3_step(insertStmt);
+		if (ret3 != SQLITE_DONE) {
+			lLastError = "Error inserting values into SQLite, error code " + std::to_string(ret3) + "!\n" + sqlite3_errmsg(sqliteDB);
+			return false;
+		}
+		sqlite3_reset(insertStmt);
+
+		if (haveStreamedBlobs) {
+			sqlite3_int64 rowid = sqlite3_last_insert_rowid(sqliteDB);
+			for (size_t j = 0; j < row.size(); j++) {
+				if (row[j].kind == FieldValue::StreamedBlob && !writeStreamedBlob(rowid, lColumnNames[j], row[j])) {
+					return false;
+				}
+			}
+		}
+
+		// For large tables, force commit to SQLite all 100000 rows:
+		if (++rowsInTransaction >= 100000) {
+			endTransaction();
+			beginTransaction();
+		}
+		return true;
+	}
+
+	bool SqliteWriter::writeColumnTypes(const TableDefinition &table) {
+		if (columnTypesStmt == nullptr) {
+			char *sqlErrorMsg;
+			sqlite3_exec(sqliteDB,
+			             "CREATE TABLE IF NOT EXISTS pgtosqlite_column_types ("
+			             " table_name TEXT NOT NULL, column_name TEXT NOT NULL, sqlite_type TEXT NOT NULL, pg_type TEXT NOT NULL,"
+			             " PRIMARY KEY (table_name, column_name));",
+			             nullptr, nullptr, &sqlErrorMsg);
+			if (sqlErrorMsg != nullptr) {
+				lLastError = std::string("Error creating pgtosqlite_column_types!\n") + sqlErrorMsg;
+				sqlite3_free(sqlErrorMsg);
+				return false;
+			}
+			if (sqlite3_prepare_v2(sqliteDB, "INSERT OR REPLACE INTO pgtosqlite_column_types VALUES (?, ?, ?, ?);", -1, &columnTypesStmt, nullptr) != SQLITE_OK) {
+				lLastError = std::string("Error preparing insert into pgtosqlite_column_types!\n") + sqlite3_errmsg(sqliteDB);
+				return false;
+			}
+		}
+
+		for (size_t col = 0; col < table.columnNames.size() && col < table.sourceTypes.size() && col < table.columnTypes.size(); col++) {
+			sqlite3_bind_text(columnTypesStmt, 1, table.name.c_str(), -1, SQLITE_STATIC);
+			sqlite3_bind_text(columnTypesStmt, 2, table.columnNames[col].c_str(), -1, SQLITE_STATIC);
+			sqlite3_bind_text(columnTypesStmt, 3, table.columnTypes[col].c_str(), -1, SQLITE_STATIC);
+			sqlite3_bind_text(columnTypesStmt, 4, table.sourceTypes[col].c_str(), -1, SQLITE_STATIC);
+			int ret = sqlite3_step(columnTypesStmt);
+			sqlite3_reset(columnTypesStmt);
+			if (ret != SQLITE_DONE) {
+				lLastError = "Error inserting into pgtosqlite_column_types, error code " + std::to_string(ret) + "!\n" + sqlite3_errmsg(sqliteDB);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool SqliteWriter::writeStreamedBlob(sqlite3_int64 rowid, const std::string &columnName, const FieldValue &field) {
+		sqlite3_blob *blob;
+		if (sqlite3_blob_open(sqliteDB, "main", lTableName.c_str(), columnName.c_str(), rowid, 1, &blob) != SQLITE_OK) {
+			lLastError = "Error opening blob in column '" + columnName + "' for writing!\n" + sqlite3_errmsg(sqliteDB);
+			sqlite3_blob_close(blob);
+			return false;
+		}
+		blobBuffer.resize(blobChunkSize);
+		size_t written = 0;
+		while (written < field.size) {
+			long long readBytes = field.source->read(blobBuffer.data(), std::min(blobChunkSize, field.size - written));
+			if (readBytes <= 0) {
+				lLastError = "Expected " + std::to_string(field.size) + " bytes for blob in column '" + columnName + "', got " + std::to_string(written) + "!";
+				sqlite3_blob_close(blob);
+				return false;
+			}
+			// Offsets are ints, which is fine as SQLite limits blobs to SQLITE_MAX_LENGTH (at most 2 GiB) anyway.
+			int ret = sqlite3_blob_write(blob, blobBuffer.data(), readBytes, written);
+			if (ret != SQLITE_OK) {
+				lLastError = "Error writing blob in column '" + columnName + "', error code " + std::to_string(ret) + "!\n" + sqlite3_errmsg(sqliteDB);
+				sqlite3_blob_close(blob);
+				return false;
+			}
+			written += readBytes;
+		}
+		if (sqlite3_blob_close(blob) != SQLITE_OK) {
+			lLastError = "Error closing blob in column '" + columnName + "'!\n" + std::string(sqlite3_errmsg(sqliteDB));
+			return false;
+		}
+		return true;
+	}
+
+	bool SqliteWriter::endTable(const TableStatistics &statistics) {
+		if (insertStmt != nullptr) {
+			sqlite3_finalize(insertStmt);
+			insertStmt = nullptr;
+		}
+		if (statInsertStmt == nullptr) {
+			return true;
+		}
+		if (statistics.needsAnalyze) {
+			tablesToAnalyze.push_back(lTableName);
+			return true;
+		}
+		for (const auto & statRow : statistics.rows) {
+			sqlite3_bind_text(statInsertStmt, 1, lTableName.c_str(), -1, SQLITE_STATIC);
+			if (statRow.first.empty()) {
+				sqlite3_bind_null(statInsertStmt, 2);
+			} else {
+				sqlite3_bind_text(statInsertStmt, 2, statRow.first.c_str(), -1, SQLITE_STATIC);
+			}
+			sqlite3_bind_text(statInsertStmt, 3, statRow.second.c_str(), -1, SQLITE_STATIC);
+			if (sqlite3_step(statInsertStmt) != SQLITE_DONE) {
+				err() << "Error inserting statistics into sqlite_stat1!" << std::endl;
+				err() << sqlite3_errmsg(sqliteDB) << std::endl;
+			}
+			sqlite3_reset(statInsertStmt);
+		}
+		return true;
+	}
+
+	bool SqliteWriter::finish(bool success) {
+		if (sqliteDB == nullptr) {
+			return success;
+		}
+		if (insertStmt != nullptr) {
+			sqlite3_finalize(insertStmt);
+			insertStmt = nullptr;
+		}
+		if (columnTypesStmt != nullptr) {
+			sqlite3_finalize(columnTypesStmt);
+			columnTypesStmt = nullptr;
+		}
+		bool haveStatistics = (statInsertStmt != nullptr);
+		if (statInsertStmt != nullptr) {
+			sqlite3_finalize(statInsertStmt);
+			statInsertStmt = nullptr;
+		}
+
+		// End the transaction, reenables autocommit
+		endTransaction();
+
+		if (success) {
+			analyze(haveStatistics);
+		}
+
+		sqlite3_close(sqliteDB);
+		sqliteDB = nullptr;
+
+		if (success) {
+			out() << "Successfully saved SQLite-database to '" << lFilename << "'." << std::endl;
+		}
+		return success;
+	}
+
+	void SqliteWriter::analyze(bool haveStatistics) {
+		if (haveStatistics) {
+			out() << "Took statistics from PostgreSQL, running bounded 'ANALYZE' on " << tablesToAnalyze.size() << " tables without... ";
+			std::string analysisLimitQuery = "PRAGMA analysis_limit=" + std::to_string(lOptions.analysisLimit) + ";";
+			sqlite3_exec(sqliteDB, analysisLimitQuery.c_str(), nullptr, nullptr, nullptr);
+			bool analyzeFailed = false;
+			for (const auto & tableName : tablesToAnalyze) {
+				std::string analyzeQuery = "ANALYZE \"" + tableName + "\";";
+				char *sqlErrorMsg;
+				sqlite3_exec(sqliteDB, analyzeQuery.c_str(), nullptr, nullptr, &sqlErrorMsg);
+				if (sqlErrorMsg != nullptr) {
+					if (!analyzeFailed) {
+						out() << std::endl;
+					}
+					analyzeFailed = true;
+					err() << std::setw(10) << "" << "Error running '" << analyzeQuery << "'!" << std::endl;
+					err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+					err() << std::setw(10) << "" << "Ignoring..." << std::endl;
+				}
+				sqlite3_free(sqlErrorMsg);
+			}
+			if (!analyzeFailed) {
+				out() << "Done!" << std::endl;
+			}
+		} else {
+			out() << "Running 'ANALYZE;' on fresh SQLite DB to help query-planner... ";
+			char *sqlErrorMsg;
+			sqlite3_exec(sqliteDB, "ANALYZE;", nullptr, nullptr, &sqlErrorMsg);
+			if (sqlErrorMsg != nullptr) {
+				out() << std::endl;
+				err() << std::setw(10) << "" << "Error running 'ANALYZE;'!" << std::endl;
+				err() << std::setw(10) << "" << sqlErrorMsg << std::endl;
+				err() << std::setw(10) << "" << "Ignoring..." << std::endl;
+			} else {
+				out() << "Done!" << std::endl;
+			}
+			sqlite3_free(sqlErrorMsg);
+		}
+	}
+
+} // namespace pgToSqlite
@@ -0,0 +1,80 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_SQLITEWRITER_H
+#define PGTOSQLITE_SQLITEWRITER_H
+
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "exporter.h"
+#include "tableSink.h"
+
+namespace pgToSqlite {
+
+	// Writes tables into a new SQLite database.
+	class SqliteWriter : public TableSink {
+	  public:
+		// Uses the output streams and statistics settings of options.
+		SqliteWriter(const std::string &sqliteFilename, const ExportOptions &options);
+		~SqliteWriter() override;
+
+		bool open() override;
+		Result beginTable(const TableDefinition &table) override;
+		bool writeRow(const std::vector<FieldValue> &row) override;
+		bool endTable(const TableStatistics &statistics) override;
+		bool finish(bool success) override;
+
+	  private:
+		void beginTransaction();
+		void endTransaction();
+		// Runs a bounded 'ANALYZE' on tables lacking statistics if sqlite_stat1 was filled, otherwise a full one.
+		void analyze(bool haveStatistics);
+		// Records the PostgreSQL types of mapped columns in pgtosqlite_column_types.
+		bool writeColumnTypes(const TableDefinition &table);
+		// Copies a streamed blob into the zeroblob of the row just inserted.
+		bool writeStreamedBlob(sqlite3_int64 rowid, const std::string &columnName, const FieldValue &field);
+
+		std::ostream &out() {
+			return *lOptions.out;
+		}
+		std::ostream &err() {
+			return *lOptions.err;
+		}
+
+		std::string lFilename;
+		const ExportOptions &lOptions;
+
+		sqlite3 *sqliteDB = nullptr;
+		sqlite3_stmt *insertStmt = nullptr;
+		sqlite3_stmt *statInsertStmt = nullptr;
+		sqlite3_stmt *columnTypesStmt = nullptr;
+		bool strictUnsupportedReported = false;
+
+		std::string lTableName;
+		std::vector<std::string> lColumnNames;
+		// Chunk buffer for streamed blobs.
+		std::vector<char> blobBuffer;
+		// Rows written since the last commit.
+		long long rowsInTransaction = 0;
+		// Tables without statistics from PostgreSQL, analyzed at the end.
+		std::vector<std::string> tablesToAnalyze;
+	};
+
+} // namespace pgToSqlite
+
+#endif
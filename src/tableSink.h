@@ -0,0 +1,109 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_TABLESINK_H
+#define PGTOSQLITE_TABLESINK_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pgToSqlite {
+
+	// Blobs are read from a BlobSource in chunks of this size.
+	const size_t blobChunkSize = 4 * 1024 * 1024;
+
+	// Sequential source for blobs too large to be held in memory.
+	class BlobSource {
+	  public:
+		virtual ~BlobSource() {}
+		// Reads up to size bytes into buffer, returns the number of bytes read or -1 on errors.
+		virtual long long read(char *buffer, size_t size) = 0;
+	};
+
+	// A single value of a row. The data is owned by the producer and stays valid until writeRow() returns.
+	// StreamedBlob values have no data, but size bytes to be read from source.
+	// Integer and Real values are given as text (not necessarily terminated) and stored as numbers.
+	struct FieldValue {
+		enum Kind : unsigned char {
+			Null = 0,
+			Text = 1,
+			Blob = 2,
+			StreamedBlob = 3,
+			Integer = 4,
+			Real = 5
+		};
+		Kind kind;
+		const char *data;
+		size_t size;
+		BlobSource *source;
+	};
+
+	// Everything needed to recreate a table, already translated to SQLite.
+	struct TableDefinition {
+		std::string name;
+		std::vector<std::string> columnNames;
+		std::string createQuery;
+		std::vector<std::string> triggerQueries;
+		std::vector<std::string> indexQueries;
+		std::vector<std::string> viewQueries;
+		// Declared SQLite types of the columns and the PostgreSQL types they were mapped from.
+		// Empty if the PostgreSQL type names were used as they are.
+		std::vector<std::string> columnTypes;
+		std::vector<std::string> sourceTypes;
+		// Create the table as STRICT, if SQLite supports it.
+		bool strict = false;
+	};
+
+	// Planner statistics for a table, derived from PostgreSQL.
+	struct TableStatistics {
+		// sqlite_stat1 rows as (index name, stat); an empty index name is the row for the table itself.
+		std::vector<std::pair<std::string, std::string>> rows;
+		// PostgreSQL had no usable statistics, the table needs to be analyzed.
+		bool needsAnalyze = false;
+	};
+
+	// Receives the tables of an export one after the other.
+	class TableSink {
+	  public:
+		enum class Result {
+			Ok,
+			SkipTable,
+			Error
+		};
+
+		virtual ~TableSink() {}
+
+		// Prepares the output, called once before the first table.
+		virtual bool open() = 0;
+		// Creates a table. SkipTable means the table can not be written, but the export may go on.
+		virtual Result beginTable(const TableDefinition &table) = 0;
+		virtual bool writeRow(const std::vector<FieldValue> &row) = 0;
+		virtual bool endTable(const TableStatistics &statistics) = 0;
+		// Completes the output. After a failed export, this only releases resources.
+		virtual bool finish(bool success) = 0;
+
+		// Reason for the last fatal error.
+		const std::string &lastError() const {
+			return lLastError;
+		}
+
+	  protected:
+		std::string lLastError;
+	};
+
+} // namespace pgToSqlite
+
+#endif
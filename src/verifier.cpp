@@ -0,0 +1,293 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "verifier.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+
+#include <sqlite3.h>
+
+namespace pgToSqlite {
+
+	namespace {
+		// MD5 as of RFC 1321.
+		class Md5 {
+		  public:
+			Md5() {
+				reset();
+			}
+
+			void reset() {
+				state[0] = 0x67452301;
+				state[1] = 0xefcdab89;
+				state[2] = 0x98badcfe;
+				state[3] = 0x10325476;
+				length = 0;
+			}
+
+			void update(const unsigned char *data, size_t size) {
+				size_t used = length % 64;
+				length += size;
+				if (used > 0) {
+					size_t fill = std::min(size, 64 - used);
+					memcpy(block + used, data, fill);
+					data += fill;
+					size -= fill;
+					if (used + fill < 64) {
+						return;
+					}
+					transform(block);
+				}
+				for (; size >= 64; data += 64, size -= 64) {
+					transform(data);
+				}
+				memcpy(block, data, size);
+			}
+
+			void final(unsigned char digest[16]) {
+				uint64_t bits = length * 8;
+				unsigned char padding[72] = {0x80};
+				size_t used = length % 64;
+				size_t padSize = (used < 56) ? (56 - used) : (120 - used);
+				unsigned char lengthBytes[8];
+				for (int i = 0; i < 8; i++) {
+					lengthBytes[i] = static_cast<unsigned char>(bits >> (8 * i));
+				}
+				update(padding, padSize);
+				update(lengthBytes, 8);
+				for (int i = 0; i < 16; i++) {
+					digest[i] = static_cast<unsigned char>(state[i / 4] >> (8 * (i % 4)));
+				}
+				reset();
+			}
+
+		  private:
+			static uint32_t rotate(uint32_t x, int c) {
+				return (x << c) | (x >> (32 - c));
+			}
+
+			void transform(const unsigned char *chunk) {
+				static const uint32_t k[64] = {
+					0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+					0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+					0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+					0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+					0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+					0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+					0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+					0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+				};
+				static const int shifts[64] = {
+					7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+					5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+					4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+					6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+				};
+				uint32_t m[16];
+				for (int i = 0; i < 16; i++) {
+					m[i] = static_cast<uint32_t>(chunk[4 * i]) | (static_cast<uint32_t>(chunk[4 * i + 1]) << 8) |
+					       (static_cast<uint32_t>(chunk[4 * i + 2]) << 16) | (static_cast<uint32_t>(chunk[4 * i + 3]) << 24);
+				}
+				uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+				for (int i = 0; i < 64; i++) {
+					uint32_t f;
+					int g;
+					if (i < 16) {
+						f = (b & c) | (~b & d);
+						g = i;
+					} else if (i < 32) {
+						f = (d & b) | (~d & c);
+						g = (5 * i + 1) % 16;
+					} else if (i < 48) {
+						f = b ^ c ^ d;
+						g = (3 * i + 5) % 16;
+					} else {
+						f = c ^ (b | ~d);
+						g = (7 * i) % 16;
+					}
+					uint32_t next = d;
+					d = c;
+					c = b;
+					b = b + rotate(a + f + k[i] + m[g], shifts[i]);
+					a = next;
+				}
+				state[0] += a;
+				state[1] += b;
+				state[2] += c;
+				state[3] += d;
+			}
+
+			uint32_t state[4];
+			uint64_t length;
+			unsigned char block[64];
+		};
+
+		void putBigEndian(std::vector<unsigned char> &buffer, uint64_t value, int bytes) {
+			for (int i = bytes - 1; i >= 0; i--) {
+				buffer.push_back(static_cast<unsigned char>(value >> (8 * i)));
+			}
+		}
+
+		void putDouble(std::vector<unsigned char> &buffer, double value) {
+			// Adding 0 turns -0 into +0, SQLite does not keep the sign of zeros stored as integer.
+			value += 0.0;
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			buffer.push_back(0x01);
+			putBigEndian(buffer, bits, 8);
+		}
+
+		struct RangeResult {
+			long long rowCount = 0;
+			uint64_t hash = 0;
+			std::string error;
+		};
+
+		void hashRange(const std::string &sqliteFilename, const std::string &tableName,
+		               sqlite3_int64 firstRowid, sqlite3_int64 lastRowid, RangeResult &result) {
+			sqlite3 *db = nullptr;
+			if (sqlite3_open_v2(sqliteFilename.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+				result.error = std::string("Can't open ") + sqliteFilename + ": " + sqlite3_errmsg(db);
+				sqlite3_close(db);
+				return;
+			}
+			std::string query = "SELECT * FROM \"" + tableName + "\" WHERE rowid BETWEEN ? AND ?;";
+			sqlite3_stmt *stmt = nullptr;
+			if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+				result.error = std::string("Can't scan table ") + tableName + ": " + sqlite3_errmsg(db);
+				sqlite3_close(db);
+				return;
+			}
+			sqlite3_bind_int64(stmt, 1, firstRowid);
+			sqlite3_bind_int64(stmt, 2, lastRowid);
+
+			int colCount = sqlite3_column_count(stmt);
+			std::vector<unsigned char> row;
+			Md5 md5;
+			unsigned char digest[16];
+			int rc;
+			while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+				row.clear();
+				for (int j = 0; j < colCount; j++) {
+					switch (sqlite3_column_type(stmt, j)) {
+						case SQLITE_NULL:
+							row.push_back(0x00);
+							break;
+						case SQLITE_INTEGER:
+							putDouble(row, static_cast<double>(sqlite3_column_int64(stmt, j)));
+							break;
+						case SQLITE_FLOAT:
+							putDouble(row, sqlite3_column_double(stmt, j));
+							break;
+						case SQLITE_BLOB: {
+							const unsigned char *blob = static_cast<const unsigned char *>(sqlite3_column_blob(stmt, j));
+							md5.update(blob, sqlite3_column_bytes(stmt, j));
+							md5.final(digest);
+							row.push_back(0x02);
+							row.insert(row.end(), digest, digest + 16);
+							break;
+						}
+						default: {
+							const unsigned char *text = sqlite3_column_text(stmt, j);
+							int size = sqlite3_column_bytes(stmt, j);
+							row.push_back(0x03);
+							putBigEndian(row, static_cast<uint32_t>(size), 4);
+							row.insert(row.end(), text, text + size);
+							break;
+						}
+					}
+				}
+				md5.update(row.data(), row.size());
+				md5.final(digest);
+				uint64_t rowHash = 0;
+				for (int i = 0; i < 8; i++) {
+					rowHash = (rowHash << 8) | digest[i];
+				}
+				result.hash += rowHash;
+				result.rowCount++;
+			}
+			if (rc != SQLITE_DONE) {
+				result.error = std::string("Error scanning table ") + tableName + ": " + sqlite3_errmsg(db);
+			}
+			sqlite3_finalize(stmt);
+			sqlite3_close(db);
+		}
+	}
+
+	bool hashSqliteTable(const std::string &sqliteFilename, const std::string &tableName, unsigned threads,
+	                     long long &rowCount, uint64_t &hash, std::string &error) {
+		rowCount = 0;
+		hash = 0;
+
+		// Split the rowid range evenly, which works well as the export assigns rowids densely.
+		sqlite3_int64 minRowid = 0;
+		sqlite3_int64 maxRowid = -1;
+		{
+			sqlite3 *db = nullptr;
+			if (sqlite3_open_v2(sqliteFilename.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+				error = std::string("Can't open ") + sqliteFilename + ": " + sqlite3_errmsg(db);
+				sqlite3_close(db);
+				return false;
+			}
+			std::string query = "SELECT min(rowid), max(rowid) FROM \"" + tableName + "\";";
+			sqlite3_stmt *stmt = nullptr;
+			if ((sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_ROW)) {
+				error = std::string("Can't scan table ") + tableName + ": " + sqlite3_errmsg(db);
+				sqlite3_finalize(stmt);
+				sqlite3_close(db);
+				return false;
+			}
+			if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+				minRowid = sqlite3_column_int64(stmt, 0);
+				maxRowid = sqlite3_column_int64(stmt, 1);
+			}
+			sqlite3_finalize(stmt);
+			sqlite3_close(db);
+		}
+		if (maxRowid < minRowid) {
+			return true;
+		}
+
+		uint64_t span = static_cast<uint64_t>(maxRowid) - static_cast<uint64_t>(minRowid) + 1;
+		uint64_t rangeCount = std::max<uint64_t>(1, std::min<uint64_t>(threads, span));
+		uint64_t rangeSize = (span + rangeCount - 1) / rangeCount;
+
+		std::vector<RangeResult> results(rangeCount);
+		std::vector<std::thread> workers;
+		for (uint64_t i = 0; i < rangeCount; i++) {
+			sqlite3_int64 first = static_cast<sqlite3_int64>(static_cast<uint64_t>(minRowid) + i * rangeSize);
+			sqlite3_int64 last = (i == rangeCount - 1) ? maxRowid : static_cast<sqlite3_int64>(static_cast<uint64_t>(first) + rangeSize - 1);
+			workers.emplace_back(hashRange, std::cref(sqliteFilename), std::cref(tableName), first, last, std::ref(results[i]));
+		}
+		for (auto & worker : workers) {
+			worker.join();
+		}
+
+		for (const auto & result : results) {
+			if (!result.error.empty()) {
+				error = result.error;
+				return false;
+			}
+			rowCount += result.rowCount;
+			hash += result.hash;
+		}
+		return true;
+	}
+
+} // namespace pgToSqlite
@@ -0,0 +1,43 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGTOSQLITE_VERIFIER_H
+#define PGTOSQLITE_VERIFIER_H
+
+#include <cstdint>
+#include <string>
+
+// Tables are compared by row count and an order-independent content hash, computed the same way
+// on PostgreSQL (as an aggregate query) and on SQLite (by scanning the output).
+//
+// Each value is encoded the way SQLite stores it:
+//   NULL:              0x00
+//   INTEGER / REAL:    0x01, the value as big-endian IEEE double (-0 as +0)
+//   BLOB:              0x02, md5 of the blob
+//   TEXT:              0x03, big-endian int32 byte length, the bytes
+// A row hashes to the first 8 bytes (big-endian) of the md5 of its encoded values,
+// the table hash is the sum of all row hashes modulo 2^64.
+// md5 is used as it is what PostgreSQL can compute server-side on all supported versions.
+
+namespace pgToSqlite {
+
+	// Hashes a table of an SQLite database, splitting it by rowid across up to threads read-only connections.
+	// Returns false on errors with the reason in error.
+	bool hashSqliteTable(const std::string &sqliteFilename, const std::string &tableName, unsigned threads,
+	                     long long &rowCount, uint64_t &hash, std::string &error);
+
+} // namespace pgToSqlite
+
+#endif
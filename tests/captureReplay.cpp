@@ -0,0 +1,225 @@
+/*
+   pgToSqlite  C++ tool to dump a PostgreSQL database to SQLite3.
+    Copyright (C) 2013-2020  Oliver Freyermuth
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replays captures into SQLite without a PostgreSQL server:
+//   captureReplay <fixture> <work directory>
+// checks the fixture capture, a capture written from the same rows and corrupted copies of it.
+// "captureReplay --write <fixture>" recreates the fixture after a change of the capture format.
+
+#include "capture.h"
+#include "sqliteWriter.h"
+
+#include <sqlite3.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace pgToSqlite;
+
+namespace {
+
+	const char corruptMarker[] = "corrupt-me";
+
+	FieldValue field(FieldValue::Kind kind, const char *data, size_t size) {
+		FieldValue value;
+		value.kind = kind;
+		value.data = data;
+		value.size = size;
+		value.source = nullptr;
+		return value;
+	}
+
+	FieldValue field(FieldValue::Kind kind, const char *text) {
+		return field(kind, text, (text != nullptr) ? strlen(text) : 0);
+	}
+
+	TableDefinition fixtureTable() {
+		TableDefinition table;
+		table.name = "fixture";
+		table.columnNames = {"id", "amount", "name", "data"};
+		table.createQuery = "CREATE TABLE fixture (id INTEGER, amount REAL, name TEXT, data BLOB);";
+		table.indexQueries = {"CREATE INDEX fixture_name ON fixture (name);"};
+		table.viewQueries = {"CREATE VIEW fixture_readable AS SELECT id, name FROM fixture;"};
+		table.columnTypes = {"INTEGER", "REAL", "TEXT", "BLOB"};
+		table.sourceTypes = {"bigint", "double precision", "text", "bytea"};
+		return table;
+	}
+
+	// Writes the rows checked by checkDatabase() into sink.
+	bool writeFixture(TableSink &sink) {
+		static const char blob[] = {'\0', '\x01', '\xff'};
+		std::vector<std::vector<FieldValue>> rows = {
+			{field(FieldValue::Integer, "9007199254740993"), field(FieldValue::Real, "1.5"), field(FieldValue::Text, "first"), field(FieldValue::Blob, blob, sizeof(blob))},
+			{field(FieldValue::Integer, "-2"), field(FieldValue::Real, "-Infinity"), field(FieldValue::Null, nullptr), field(FieldValue::Null, nullptr)},
+			{field(FieldValue::Integer, "3"), field(FieldValue::Null, nullptr), field(FieldValue::Text, corruptMarker), field(FieldValue::Blob, blob, 0)}
+		};
+		TableStatistics statistics;
+		statistics.rows.push_back(std::make_pair("", "3"));
+		statistics.rows.push_back(std::make_pair("fixture_name", "3 1"));
+
+		if (!sink.open() || (sink.beginTable(fixtureTable()) != TableSink::Result::Ok)) {
+			return false;
+		}
+		for (const auto & row : rows) {
+			if (!sink.writeRow(row)) {
+				return false;
+			}
+		}
+		return sink.endTable(statistics) && sink.finish(true);
+	}
+
+	bool fail(const std::string &message) {
+		std::cerr << message << std::endl;
+		return false;
+	}
+
+	// Compares the database against the rows of writeFixture().
+	bool checkDatabase(const std::string &sqliteFilename) {
+		sqlite3 *db = nullptr;
+		if (sqlite3_open_v2(sqliteFilename.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+			sqlite3_close(db);
+			return fail("Can't open " + sqliteFilename + "!");
+		}
+		const char *query =
+		    "SELECT group_concat(quote(id) || '|' || quote(amount) || '|' || quote(name) || '|' || quote(data), ';') FROM "
+		    "(SELECT * FROM fixture ORDER BY rowid)";
+		const std::string expected = "9007199254740993|1.5|'first'|X'0001FF';-2|-Inf|NULL|NULL;3|NULL|'corrupt-me'|X''";
+		const char *statQuery = "SELECT group_concat(idx || ':' || stat, ';') FROM (SELECT * FROM sqlite_stat1 ORDER BY idx)";
+		const std::string expectedStats = "fixture_name:3 1";
+		const char *viewQuery = "SELECT count(*) FROM fixture_readable";
+
+		std::string rows, stats, viewRows;
+		for (auto check : {std::make_pair(query, &rows), std::make_pair(statQuery, &stats), std::make_pair(viewQuery, &viewRows)}) {
+			sqlite3_stmt *stmt = nullptr;
+			if ((sqlite3_prepare_v2(db, check.first, -1, &stmt, nullptr) == SQLITE_OK) && (sqlite3_step(stmt) == SQLITE_ROW) &&
+			    (sqlite3_column_text(stmt, 0) != nullptr)) {
+				*check.second = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+			} else {
+				*check.second = sqlite3_errmsg(db);
+			}
+			sqlite3_finalize(stmt);
+		}
+		sqlite3_close(db);
+
+		if (rows != expected) {
+			return fail(sqliteFilename + ": expected rows " + expected + ", got " + rows);
+		}
+		if (stats.find(expectedStats) == std::string::npos) {
+			return fail(sqliteFilename + ": expected statistics " + expectedStats + ", got " + stats);
+		}
+		if (viewRows != "3") {
+			return fail(sqliteFilename + ": expected 3 rows in the view, got " + viewRows);
+		}
+		return true;
+	}
+
+	// Replays the capture into a new database, returns whether that worked and leaves the error in error.
+	bool replay(const std::string &captureFilename, const std::string &sqliteFilename, std::string &error) {
+		remove(sqliteFilename.c_str());
+		static std::ostringstream discarded;
+		ExportOptions options;
+		options.out = &discarded;
+		options.err = &discarded;
+		// Keep the statistics of the capture, as an export with them would.
+		options.statsFromPostgres = true;
+
+		CaptureReader reader;
+		if (!reader.open(captureFilename)) {
+			error = reader.lastError();
+			return false;
+		}
+		SqliteWriter writer(sqliteFilename, options);
+		long long rowCount = 0;
+		if (!reader.replay(writer, rowCount)) {
+			error = reader.lastError();
+			return false;
+		}
+		if (rowCount != 3) {
+			error = "Replayed " + std::to_string(rowCount) + " rows instead of 3";
+			return false;
+		}
+		return true;
+	}
+
+	bool replayAndCheck(const std::string &captureFilename, const std::string &sqliteFilename) {
+		std::string error;
+		if (!replay(captureFilename, sqliteFilename, error)) {
+			return fail(captureFilename + ": " + error);
+		}
+		return checkDatabase(sqliteFilename);
+	}
+
+	// Sets the kind of the marker value to kind (streamed blobs or unknown), replay has to reject the capture.
+	bool checkCorruptKind(const std::string &captureFilename, const std::string &workDirectory, unsigned char kind) {
+		std::ifstream in(captureFilename, std::ios::binary);
+		std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		size_t marker = content.find(corruptMarker);
+		if ((marker == std::string::npos) || (marker < 2)) {
+			return fail(captureFilename + ": marker value not found");
+		}
+		// Kind, then the size as a single byte varint.
+		content[marker - 2] = static_cast<char>(kind);
+
+		std::string corruptFilename = workDirectory + "/corrupt.cap";
+		std::ofstream(corruptFilename, std::ios::binary) << content;
+		std::string error;
+		if (replay(corruptFilename, workDirectory + "/corrupt.sqlite", error)) {
+			return fail("Capture with value kind " + std::to_string(kind) + " was replayed");
+		}
+		if (error.find("corrupt") == std::string::npos) {
+			return fail("Capture with value kind " + std::to_string(kind) + " failed with: " + error);
+		}
+		return true;
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	if ((argc == 3) && (strcmp(argv[1], "--write") == 0)) {
+		remove(argv[2]);
+		CaptureWriter capture(argv[2], true);
+		return writeFixture(capture) ? 0 : 1;
+	}
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <fixture> <work directory> | --write <fixture>" << std::endl;
+		return 2;
+	}
+	std::string fixture = argv[1];
+	std::string workDirectory = argv[2];
+
+	bool ok = replayAndCheck(fixture, workDirectory + "/fixture.sqlite");
+
+	// A capture written now has to replay the same way.
+	std::string roundTrip = workDirectory + "/roundTrip.cap";
+	remove(roundTrip.c_str());
+	CaptureWriter capture(roundTrip, true);
+	if (!writeFixture(capture)) {
+		ok = fail("Writing " + roundTrip + " failed: " + capture.lastError());
+	} else {
+		ok = replayAndCheck(roundTrip, workDirectory + "/roundTrip.sqlite") && ok;
+		for (unsigned char kind : {3, 6, 255}) {
+			ok = checkCorruptKind(roundTrip, workDirectory, kind) && ok;
+		}
+	}
+
+	std::cout << (ok ? "All capture checks passed." : "Capture checks failed!") << std::endl;
+	return ok ? 0 : 1;
+}